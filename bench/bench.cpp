@@ -0,0 +1,311 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// End-to-end benchmark of the codec binary over a corpus of files. Each file is
+// compressed and decompressed in all modes, measuring speed, compression factor,
+// and peak memory usage. The results are printed as CSV or JSON.
+//------------------------------------------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+const string HELP_MESSAGE =
+"USAGE:\n"
+"  bench [-c CODEC] [-f FORMAT] [-r RUNS] [-m MODES] [-w WIDTH] [PATH...] | -h\n"
+"\n"
+"OPTION:\n"
+"  -c     codec binary (default: ./huffman-codec)\n"
+"  -f     output format: csv or json (default: csv)\n"
+"  -r     number of runs, the fastest one is reported (default: 3)\n"
+"  -m     modes separated by commas, each mode is a list of codec options\n"
+"  -w     width of 2D data (default: 512)\n"
+"  -h     show this help\n"
+"  PATH   corpus file or directory with *.raw files (default: data)\n";
+
+// all combinations of the main compression options (more may be given by -m)
+const vector<string> DEFAULT_MODES = {
+    "", "-m", "-a", "-a -m", "-t", "-t -m", "-s", "-s -m", "-s -a -m",
+    "-p med", "-p auto", "-a -p auto", "-x -a -m", "-x -p auto", "-a -r",
+    "-m -k 64K", "-a -m -k 64K"
+};
+
+// result of one run of the codec
+struct RunResult
+{
+    bool success;
+    double seconds;
+    long maxRSS; // in KiB
+};
+
+// results of one mode for one file
+struct BenchResult
+{
+    string filePath;
+    string mode;
+    uint64_t rawSize;
+    uint64_t packedSize;
+    double comprSpeed; // MB/s
+    double decomprSpeed;
+    long comprRSS;
+    long decomprRSS;
+    string status; // ok, mismatch (round trip), or error (codec failed)
+};
+
+
+// split given string to words separated by given delimiter (empty words skipped)
+vector<string> splitString(const string &str, char delimiter)
+{
+    vector<string> words;
+    stringstream ss(str);
+    string word;
+    while (getline(ss, word, delimiter))
+    {
+        if (!word.empty()) {
+            words.push_back(word);
+        }
+    }
+    return words;
+}
+
+// run the codec with given arguments, it waits for it and measures its resources
+RunResult runCodec(const string &codecPath, const vector<string> &args)
+{
+    vector<char *> argv = {(char *) codecPath.c_str()};
+    for (const string &arg : args) {
+        argv.push_back((char *) arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) // child process
+    {
+        int nullFd = open("/dev/null", O_WRONLY);
+        dup2(nullFd, STDERR_FILENO); // codec info is not needed
+        execv(codecPath.c_str(), argv.data());
+        _exit(127);
+    }
+
+    int status = 0;
+    struct rusage usage = {};
+    if (pid == -1 || wait4(pid, &status, 0, &usage) == -1) {
+        return {false, 0, 0};
+    }
+    chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+
+    bool success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return {success, seconds.count(), usage.ru_maxrss};
+}
+
+// run the codec given number of times, it returns the fastest run
+RunResult runCodecBest(const string &codecPath, const vector<string> &args, int runCount)
+{
+    RunResult best = {false, 0, 0};
+    for (int i = 0; i < runCount; i++)
+    {
+        RunResult result = runCodec(codecPath, args);
+        if (!result.success) {
+            return result;
+        }
+        if (i == 0 || result.seconds < best.seconds) {
+            best.seconds = result.seconds;
+        }
+        best.maxRSS = max(best.maxRSS, result.maxRSS);
+        best.success = true;
+    }
+    return best;
+}
+
+// compare contents of two files
+bool equalFiles(const string &filePath1, const string &filePath2)
+{
+    ifstream ifs1(filePath1, ios::binary), ifs2(filePath2, ios::binary);
+    return equal(istreambuf_iterator<char>(ifs1), istreambuf_iterator<char>(),
+                 istreambuf_iterator<char>(ifs2), istreambuf_iterator<char>());
+}
+
+// compress and decompress given file in given mode
+BenchResult benchFile(
+    const string &codecPath,
+    const string &filePath,
+    const string &mode,
+    const string &width,
+    const string &tempDir,
+    int runCount)
+{
+    string packedPath = tempDir + "/packed";
+    string unpackedPath = tempDir + "/unpacked";
+    BenchResult result = {filePath, mode, fs::file_size(filePath), 0, 0, 0, 0, 0, "error"};
+
+    vector<string> comprArgs = splitString(mode, ' ');
+    comprArgs.insert(comprArgs.end(), {"-c", "-w", width, "-i", filePath, "-o", packedPath});
+    RunResult compr = runCodecBest(codecPath, comprArgs, runCount);
+    if (!compr.success) {
+        return result;
+    }
+
+    vector<string> decomprArgs = {"-d", "-i", packedPath, "-o", unpackedPath};
+    RunResult decompr = runCodecBest(codecPath, decomprArgs, runCount);
+    if (!decompr.success) {
+        return result;
+    }
+
+    result.packedSize = fs::file_size(packedPath);
+    result.comprSpeed = result.rawSize / compr.seconds / 1e6;
+    result.decomprSpeed = result.rawSize / decompr.seconds / 1e6;
+    result.comprRSS = compr.maxRSS;
+    result.decomprRSS = decompr.maxRSS;
+    result.status = equalFiles(filePath, unpackedPath) ? "ok" : "mismatch";
+
+    return result;
+}
+
+// return bits per character of given result
+double getBPC(const BenchResult &result) {
+    return result.rawSize == 0 ? 0 : 8.0 * result.packedSize / result.rawSize;
+}
+
+void printCSV(const vector<BenchResult> &results)
+{
+    cout << "file,mode,raw_bytes,packed_bytes,bpc,compress_mbps,decompress_mbps,"
+            "compress_rss_kib,decompress_rss_kib,status\n";
+    cout << fixed << setprecision(3);
+    for (const BenchResult &result : results)
+    {
+        cout << result.filePath << ",\"" << result.mode << "\"," << result.rawSize << ","
+             << result.packedSize << "," << getBPC(result) << "," << result.comprSpeed << ","
+             << result.decomprSpeed << "," << result.comprRSS << "," << result.decomprRSS << ","
+             << result.status << "\n";
+    }
+}
+
+void printJSON(const vector<BenchResult> &results)
+{
+    cout << "[\n" << fixed << setprecision(3);
+    for (uint64_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &result = results[i];
+        cout << "  {\"file\": \"" << result.filePath << "\", \"mode\": \"" << result.mode
+             << "\", \"raw_bytes\": " << result.rawSize
+             << ", \"packed_bytes\": " << result.packedSize
+             << ", \"bpc\": " << getBPC(result)
+             << ", \"compress_mbps\": " << result.comprSpeed
+             << ", \"decompress_mbps\": " << result.decomprSpeed
+             << ", \"compress_rss_kib\": " << result.comprRSS
+             << ", \"decompress_rss_kib\": " << result.decomprRSS
+             << ", \"status\": \"" << result.status << "\"}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    cout << "]\n";
+}
+
+// entry point of program
+int main(int argc, char *argv[])
+{
+    string codecPath = "./huffman-codec";
+    string format = "csv";
+    int runCount = 3;
+    vector<string> modes = DEFAULT_MODES;
+    string width = "512";
+
+    int opt;
+    while ((opt = getopt(argc, argv, ":c:f:r:m:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c': codecPath = optarg; break;
+        case 'f': format = optarg; break;
+        case 'r': runCount = max(stoi(optarg), 1); break;
+        case 'm': modes = splitString(optarg, ','); break;
+        case 'w': width = optarg; break;
+        case 'h':
+            cout << HELP_MESSAGE;
+            return 0;
+        default:
+            cerr << "ERROR: invalid arguments\n" << HELP_MESSAGE;
+            return 1;
+        }
+    }
+    if (format != "csv" && format != "json")
+    {
+        cerr << "ERROR: unknown output format\n";
+        return 1;
+    }
+
+    // corpus files (directories are searched for raw files)
+    vector<string> filePaths;
+    vector<string> paths(argv + optind, argv + argc);
+    if (paths.empty()) {
+        paths.push_back("data");
+    }
+    for (const string &path : paths)
+    {
+        if (fs::is_directory(path))
+        {
+            vector<string> dirFilePaths;
+            for (const fs::directory_entry &entry : fs::directory_iterator(path))
+            {
+                if (entry.is_regular_file() && entry.path().extension() == ".raw") {
+                    dirFilePaths.push_back(entry.path().string());
+                }
+            }
+            sort(dirFilePaths.begin(), dirFilePaths.end());
+            filePaths.insert(filePaths.end(), dirFilePaths.begin(), dirFilePaths.end());
+        }
+        else if (fs::is_regular_file(path)) {
+            filePaths.push_back(path);
+        }
+        else
+        {
+            cerr << "ERROR: " << path << " corpus path does not exist\n";
+            return 1;
+        }
+    }
+
+    char tempDirTemplate[] = "/tmp/huffman-bench-XXXXXX";
+    if (mkdtemp(tempDirTemplate) == nullptr)
+    {
+        cerr << "ERROR: cannot create temporary directory\n";
+        return 1;
+    }
+    string tempDir = tempDirTemplate;
+
+    vector<BenchResult> results;
+    bool allPassed = true;
+    for (const string &filePath : filePaths)
+    {
+        for (const string &mode : modes)
+        {
+            results.push_back(benchFile(codecPath, filePath, mode, width, tempDir, runCount));
+            allPassed = allPassed && results.back().status == "ok";
+
+            // progress for long benchmarks (may be suppressed by ignoring stderr)
+            cerr << filePath << " [" << mode << "] " << results.back().status << "\n";
+        }
+    }
+    fs::remove_all(tempDir);
+
+    if (format == "json") {
+        printJSON(results);
+    } else {
+        printCSV(results);
+    }
+
+    return allPassed ? 0 : 2;
+}
@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Micro-benchmark of vectorized kernels (each supported instruction set).
+//------------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+
+#include "../src/simd.hpp"
+
+using namespace std;
+
+#define BENCH_SIZE (uint64_t(64) << 20) // bytes processed by one run
+#define BENCH_RUNS 10 // the best run is reported
+
+
+// return the best throughput of given kernel in GB/s
+double measureKernel(const function<void(uint8_t *, uint64_t)> &kernel, vector<uint8_t> &data)
+{
+    double bestSeconds = 0;
+    for (int i = 0; i < BENCH_RUNS; i++)
+    {
+        auto start = chrono::steady_clock::now();
+        kernel(data.data(), data.size());
+        chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+
+        if (i == 0 || seconds.count() < bestSeconds) {
+            bestSeconds = seconds.count();
+        }
+    }
+
+    return data.size() / bestSeconds / 1e9;
+}
+
+// check that given kernels give the same results as scalar ones (also odd sizes)
+bool checkKernels(SimdLevel level, const vector<uint8_t> &data)
+{
+    for (uint64_t size : {uint64_t(0), uint64_t(1), uint64_t(15), uint64_t(33), uint64_t(1000)})
+    {
+        vector<uint8_t> scalarData(data.begin(), data.begin() + size);
+        vector<uint8_t> levelData = scalarData;
+
+        applyDiffKernel(scalarData.data(), size, SIMD_SCALAR);
+        applyDiffKernel(levelData.data(), size, level);
+        if (levelData != scalarData) {
+            return false;
+        }
+
+        revertDiffKernel(levelData.data(), size, level);
+        if (levelData != vector<uint8_t>(data.begin(), data.begin() + size)) {
+            return false;
+        }
+
+        // differences contain runs (random data do not)
+        vector<uint8_t> scalarRLE(size + size / 3 + 1);
+        vector<uint8_t> levelRLE = scalarRLE;
+        scalarRLE.resize(applyRLEKernel(scalarData.data(), size, scalarRLE.data(), SIMD_SCALAR));
+        levelRLE.resize(applyRLEKernel(scalarData.data(), size, levelRLE.data(), level));
+        if (levelRLE != scalarRLE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// return data with runs of random length (mostly zeros, like smooth differences)
+vector<uint8_t> createRunData(uint64_t size, mt19937 &generator)
+{
+    vector<uint8_t> data;
+    while (data.size() < size)
+    {
+        uint64_t runLength = min<uint64_t>(generator() % 1024, size - data.size());
+        data.insert(data.end(), runLength, 0);
+        data.push_back(generator()); // literal between runs
+    }
+    data.resize(size);
+
+    return data;
+}
+
+int main()
+{
+    vector<uint8_t> data(BENCH_SIZE);
+    mt19937 generator(1);
+    for (uint8_t &item : data) {
+        item = generator();
+    }
+
+    vector<uint8_t> runData = createRunData(BENCH_SIZE, generator);
+    vector<uint8_t> rleData(BENCH_SIZE + BENCH_SIZE / 3 + 1);
+
+    cout << "kernel      level   GB/s\n";
+    for (int level = SIMD_SCALAR; level <= getSimdLevel(); level++)
+    {
+        SimdLevel simdLevel = SimdLevel(level);
+        if (!checkKernels(simdLevel, data))
+        {
+            cerr << "ERROR: " << getSimdName(simdLevel) << " kernels give wrong results\n";
+            return 1;
+        }
+
+        double applySpeed = measureKernel([simdLevel](uint8_t *kernelData, uint64_t size) {
+            applyDiffKernel(kernelData, size, simdLevel);
+        }, data);
+        double revertSpeed = measureKernel([simdLevel](uint8_t *kernelData, uint64_t size) {
+            revertDiffKernel(kernelData, size, simdLevel);
+        }, data);
+
+        // RLE of random data (no runs) and data with long runs
+        auto rleKernel = [simdLevel, &rleData](uint8_t *kernelData, uint64_t size) {
+            applyRLEKernel(kernelData, size, rleData.data(), simdLevel);
+        };
+        double rleSpeed = measureKernel(rleKernel, data);
+        double rleRunSpeed = measureKernel(rleKernel, runData);
+
+        cout << fixed << setprecision(2) << left;
+        cout << "applyDiff   " << setw(8) << getSimdName(simdLevel) << applySpeed << "\n";
+        cout << "revertDiff  " << setw(8) << getSimdName(simdLevel) << revertSpeed << "\n";
+        cout << "RLE         " << setw(8) << getSimdName(simdLevel) << rleSpeed << "\n";
+        cout << "RLE (runs)  " << setw(8) << getSimdName(simdLevel) << rleRunSpeed << "\n";
+    }
+}
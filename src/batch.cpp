@@ -0,0 +1,294 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of batch processing of multiple files.
+//------------------------------------------------------------------------------
+
+#include "batch.hpp"
+#include "mapping.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <new>
+#include <system_error>
+
+using std::ifstream;
+using std::ofstream;
+using std::ios;
+using std::streamoff;
+using std::thread;
+using std::atomic;
+using std::min;
+using std::max;
+using std::sort;
+using std::error_code;
+using std::unordered_map;
+using std::bad_alloc;
+using std::chrono::steady_clock;
+using std::chrono::duration;
+using std::filesystem::path;
+using std::filesystem::directory_iterator;
+using std::filesystem::directory_entry;
+using std::filesystem::is_directory;
+using std::filesystem::create_directories;
+using std::filesystem::weakly_canonical;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// read the whole file to given buffer (its capacity is reused)
+// it returns false when the file cannot be read (or its size is unknown)
+bool readFile(const string &filePath, vector<uint8_t> &data)
+{
+    ifstream ifs(filePath, ios::in | ios::binary | ios::ate);
+    if (ifs.fail()) {
+        return false;
+    }
+
+    streamoff fileSize = ifs.tellg();
+    if (fileSize < 0) {
+        return false;
+    }
+
+    data.resize(fileSize);
+    ifs.seekg(0);
+    ifs.read((char *) data.data(), data.size());
+    return !ifs.fail();
+}
+
+// write given data to the file, it returns false when the file cannot be written
+// regular files are replaced only by complete data (see OutputMapping), others
+// (e.g., symbolic links) are written directly
+bool writeFile(const string &filePath, const vector<uint8_t> &data)
+{
+    if (!isMappableOutput(filePath))
+    {
+        ofstream ofs(filePath, ios::out | ios::binary);
+        ofs.write((const char *) data.data(), data.size());
+        ofs.flush();
+        return !ofs.fail();
+    }
+
+    OutputMapping outFile(filePath);
+    uint8_t *target = outFile.resize(data.size());
+    if (!outFile.isValid()) {
+        return false;
+    }
+    if (!data.empty()) {
+        memcpy(target, data.data(), data.size());
+    }
+    return outFile.commit();
+}
+
+// return the path with resolved symbolic links and dots, so paths of the same
+// file are equal (the file does not need to exist)
+string getCanonicalPath(const string &filePath)
+{
+    error_code error;
+    path canonicalPath = weakly_canonical(filePath, error);
+    if (error) {
+        return path(filePath).lexically_normal().string();
+    }
+    return canonicalPath.string();
+}
+
+// return all files of the batch, directories are replaced by their regular files
+// (sorted by name), other paths are kept, so missing files fail later
+vector<string> getBatchFiles(const vector<string> &paths)
+{
+    vector<string> filePaths;
+    for (const string &curPath : paths)
+    {
+        error_code error;
+        if (!is_directory(curPath, error))
+        {
+            filePaths.push_back(curPath);
+            continue;
+        }
+
+        vector<string> dirFilePaths;
+        for (const directory_entry &entry : directory_iterator(curPath, error))
+        {
+            if (entry.is_regular_file(error)) {
+                dirFilePaths.push_back(entry.path().string());
+            }
+        }
+        sort(dirFilePaths.begin(), dirFilePaths.end());
+        filePaths.insert(filePaths.end(), dirFilePaths.begin(), dirFilePaths.end());
+    }
+
+    return filePaths;
+}
+
+// compress or decompress one file using given context and buffers
+HuffResult processFile(
+    HuffCodec &codec,
+    const string &filePath,
+    const string &outPath,
+    bool useCompr,
+    const CodecOptions &options,
+    vector<uint8_t> &inData,
+    vector<uint8_t> &outData)
+{
+    HuffResult result;
+    StageTimer readTimer(options.stats);
+    bool readOk;
+    try {
+        readOk = readFile(filePath, inData);
+    }
+    catch (const bad_alloc &) // the codec reports its own allocations
+    {
+        result.code = 26;
+        result.message = "not enough memory";
+        return result;
+    }
+
+    if (!readOk)
+    {
+        result.code = 5;
+        result.message = "cannot read " + filePath + " input file";
+        return result;
+    }
+    readTimer.stop("read", inData.size(), inData.size());
+
+    if (useCompr) {
+        result = codec.compress(inData.data(), inData.size(), options, outData);
+    } else {
+        result = codec.decompress(inData.data(), inData.size(), options, outData);
+    }
+
+    if (!result.isOk()) {
+        return result;
+    }
+
+    StageTimer writeTimer(options.stats);
+    if (!writeFile(outPath, outData))
+    {
+        result.code = 7;
+        result.message = "cannot write to " + outPath + " output file";
+    }
+    writeTimer.stop("write", outData.size(), outData.size());
+
+    return result;
+}
+
+// -------------------------- BATCH --------------------------------------------
+
+BatchResult runBatch(
+    const vector<string> &paths,
+    const string &outDir,
+    bool useCompr,
+    const CodecOptions &options,
+    unsigned int threadCount)
+{
+    steady_clock::time_point startTime = steady_clock::now();
+
+    vector<string> filePaths = getBatchFiles(paths);
+    vector<HuffResult> results(filePaths.size());
+    vector<uint64_t> inSizes(filePaths.size());
+
+    // failure to create the directory is reported by each file
+    // (it is created first, so output paths are resolved in it)
+    error_code error;
+    create_directories(outDir, error);
+
+    // files with the same output path (e.g., the same names in different directories)
+    // would overwrite each other, and outputs must not overwrite inputs, which may
+    // be read by other workers, so only the first of them (or the input) is kept
+    // paths are compared as canonical ones
+    vector<string> outPaths(filePaths.size());
+    unordered_map<string, uint64_t> firstIndices; // inputs are indexed after outputs
+    for (uint64_t i = 0; i < filePaths.size(); i++) {
+        firstIndices.emplace(getCanonicalPath(filePaths[i]), filePaths.size() + i);
+    }
+    for (uint64_t i = 0; i < filePaths.size(); i++)
+    {
+        outPaths[i] = getBatchOutPath(filePaths[i], outDir, useCompr);
+        auto firstIt = firstIndices.emplace(getCanonicalPath(outPaths[i]), i).first;
+        if (firstIt->second == i) {
+            continue;
+        }
+
+        results[i].code = 30;
+        if (firstIt->second >= filePaths.size()) {
+            results[i].message = "output file " + outPaths[i] + " is also an input file";
+        } else {
+            results[i].message = "output file " + outPaths[i] + " is the same as for "
+                + filePaths[firstIt->second];
+        }
+    }
+
+    if (threadCount == 0) {
+        threadCount = thread::hardware_concurrency();
+    }
+    threadCount = max(min(uint64_t(threadCount), uint64_t(filePaths.size())), uint64_t(1));
+
+    // files are taken one by one, so workers stay busy even for different file sizes
+    atomic<uint64_t> nextIndex(0);
+    auto runWorker = [&]()
+    {
+        HuffCodec codec(1); // files are processed in parallel, not their parts
+        vector<uint8_t> inData;
+        vector<uint8_t> outData;
+
+        uint64_t i;
+        while ((i = nextIndex++) < filePaths.size())
+        {
+            if (!results[i].isOk()) {
+                continue; // already failed
+            }
+            results[i] = processFile(
+                codec, filePaths[i], outPaths[i], useCompr, options, inData, outData);
+            inSizes[i] = inData.size();
+        }
+    };
+
+    // the calling thread is counted too
+    vector<thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++) {
+        workers.emplace_back(runWorker);
+    }
+    runWorker();
+    for (thread &worker : workers) {
+        worker.join();
+    }
+
+    BatchResult batchResult;
+    batchResult.fileCount = filePaths.size();
+    for (uint64_t i = 0; i < filePaths.size(); i++)
+    {
+        if (results[i].isOk())
+        {
+            batchResult.inSize += inSizes[i];
+            batchResult.outSize += results[i].size;
+        }
+        else {
+            batchResult.failures.push_back({filePaths[i], results[i]});
+        }
+    }
+    duration<double> seconds = steady_clock::now() - startTime;
+    batchResult.seconds = seconds.count();
+
+    return batchResult;
+}
+
+string getBatchOutPath(const string &filePath, const string &outDir, bool useCompr)
+{
+    path outPath = path(outDir) / path(filePath).filename();
+
+    if (useCompr) {
+        outPath += BATCH_COMPR_SUFFIX;
+    } else if (outPath.extension() == BATCH_COMPR_SUFFIX) {
+        outPath.replace_extension();
+    } else {
+        outPath += BATCH_DECOMPR_SUFFIX;
+    }
+
+    return outPath.string();
+}
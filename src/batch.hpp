@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of batch processing of multiple files.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "huffcodec.hpp"
+
+using std::string;
+using std::vector;
+
+#define BATCH_COMPR_SUFFIX ".huff" // appended to names of compressed files
+#define BATCH_DECOMPR_SUFFIX ".out" // appended when the suffix above is missing
+
+
+// failure of one file of a batch
+struct BatchFailure
+{
+    string filePath;
+    HuffResult result;
+};
+
+// summary of batch processing
+struct BatchResult
+{
+    uint64_t fileCount = 0;
+    uint64_t inSize = 0; // total size of all processed files
+    uint64_t outSize = 0;
+    double seconds = 0; // wall time of the whole batch
+    vector<BatchFailure> failures; // in the order of given files
+};
+
+// compress or decompress given files (directories are expanded to their regular
+// files) to given output directory, which is created when missing
+// files are processed on given number of worker threads (zero means all cores), each
+// of them has its own codec context and buffers reused for all its files
+// errors of individual files do not stop the others, they are returned in the result
+// files with the same output path as a previous file (e.g., the same names in different
+// directories), or as an input file, fail without being processed, so no output is
+// overwritten, and outputs replace existing files only when completely written
+BatchResult runBatch(
+    const vector<string> &paths,
+    const string &outDir,
+    bool useCompr,
+    const CodecOptions &options,
+    unsigned int threadCount);
+
+// return path of the output file for given input file in given output directory
+string getBatchOutPath(const string &filePath, const string &outDir, bool useCompr);
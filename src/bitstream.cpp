@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of bit stream helpers working with packed bytes.
+//------------------------------------------------------------------------------
+
+#include "bitstream.hpp"
+
+#include <climits>
+
+// -------------------------- BIT WRITER ---------------------------------------
+
+BitWriter::BitWriter(vector<uint8_t> &vec) : outVec(vec), word(0), wordBitCount(0) {}
+
+void BitWriter::write(uint64_t bits, unsigned int bitCount)
+{
+    unsigned int freeBitCount = BITS_IN_WORD - wordBitCount;
+    if (bitCount < freeBitCount)
+    {
+        if (bitCount != 0) { // shifting by the whole word is not defined
+            word |= bits << (freeBitCount - bitCount);
+            wordBitCount += bitCount;
+        }
+        return;
+    }
+
+    // fill up the word, write it and keep the remaining bits
+    unsigned int remainBitCount = bitCount - freeBitCount;
+    word |= bits >> remainBitCount;
+    writeWord(sizeof(uint64_t));
+
+    word = remainBitCount != 0 ? bits << (BITS_IN_WORD - remainBitCount) : 0;
+    wordBitCount = remainBitCount;
+}
+
+void BitWriter::flush()
+{
+    writeWord((wordBitCount + CHAR_BIT - 1) / CHAR_BIT);
+    word = 0;
+    wordBitCount = 0;
+}
+
+uint64_t BitWriter::getBitCount() const {
+    return outVec.size() * CHAR_BIT + wordBitCount;
+}
+
+void BitWriter::writeWord(unsigned int byteCount)
+{
+    uint64_t outIndex = outVec.size();
+    outVec.resize(outIndex + byteCount);
+
+    for (unsigned int i = 0; i < byteCount; i++) {
+        outVec[outIndex + i] = word >> (BITS_IN_WORD - CHAR_BIT * (i + 1));
+    }
+}
+
+// -------------------------- BIT READER ---------------------------------------
+
+BitReader::BitReader(const uint8_t *data, uint64_t byteCount) :
+    curByte(data), endByte(data + byteCount), word(0), wordBitCount(0) {}
+
+bool BitReader::readBit()
+{
+    if (wordBitCount == 0) {
+        refill();
+    }
+
+    bool bit = word >> (BITS_IN_WORD - 1);
+    word <<= 1;
+    wordBitCount--;
+    return bit;
+}
+
+uint64_t BitReader::read(unsigned int bitCount)
+{
+    if (bitCount == 0) { // shifting by the whole word is not defined
+        return 0;
+    }
+    if (wordBitCount < bitCount) {
+        refill();
+    }
+
+    uint64_t bits = word >> (BITS_IN_WORD - bitCount);
+    word <<= bitCount;
+    wordBitCount -= bitCount;
+    return bits;
+}
+
+uint64_t BitReader::peek(unsigned int bitCount)
+{
+    if (bitCount == 0) { // shifting by the whole word is not defined
+        return 0;
+    }
+    if (wordBitCount < bitCount) {
+        refill();
+    }
+
+    return word >> (BITS_IN_WORD - bitCount);
+}
+
+void BitReader::skip(unsigned int bitCount)
+{
+    if (wordBitCount < bitCount) {
+        refill();
+    }
+
+    word = bitCount < BITS_IN_WORD ? word << bitCount : 0;
+    wordBitCount -= bitCount;
+}
+
+bool BitReader::isEmpty() const {
+    return wordBitCount == 0 && curByte == endByte;
+}
+
+uint64_t BitReader::getRemainBitCount() const {
+    return wordBitCount + uint64_t(endByte - curByte) * CHAR_BIT;
+}
+
+void BitReader::refill()
+{
+    if (endByte - curByte >= int64_t(sizeof(uint64_t)))
+    {
+        // load the whole word at once (in big-endian order) and keep whole bytes of it
+        uint64_t nextWord = 0;
+        for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+            nextWord = (nextWord << CHAR_BIT) | curByte[i];
+        }
+
+        word |= nextWord >> wordBitCount;
+        unsigned int byteCount = (BITS_IN_WORD - 1 - wordBitCount) / CHAR_BIT;
+        curByte += byteCount;
+        wordBitCount += byteCount * CHAR_BIT;
+
+        if (wordBitCount < BITS_IN_WORD) { // clear bits of the partially loaded byte
+            word &= ~(~uint64_t(0) >> wordBitCount);
+        }
+    }
+    else
+    {
+        // close to the end, so load byte by byte
+        while (wordBitCount <= BITS_IN_WORD - CHAR_BIT && curByte != endByte)
+        {
+            word |= uint64_t(*curByte) << (BITS_IN_WORD - CHAR_BIT - wordBitCount);
+            curByte++;
+            wordBitCount += CHAR_BIT;
+        }
+    }
+}
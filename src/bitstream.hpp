@@ -0,0 +1,73 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of bit stream helpers working with packed bytes.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+#define BITS_IN_WORD 64 // size of bit stream register
+
+
+// writer of bits to a byte vector (the first bit is the most significant one)
+class BitWriter
+{
+public:
+    // bits are appended after the current contents of given vector
+    BitWriter(vector<uint8_t> &vec);
+
+    // write given number of the lowest bits of given value (at most the whole word)
+    void write(uint64_t bits, unsigned int bitCount);
+    // write remaining bits, the last byte is padded with zeros
+    void flush();
+    // return the number of bits in the target vector (including unflushed ones)
+    uint64_t getBitCount() const;
+
+private:
+    vector<uint8_t> &outVec;
+
+    uint64_t word; // bits are aligned to the most significant bit
+    unsigned int wordBitCount;
+
+    // append given number of bytes from the word to the target vector
+    void writeWord(unsigned int byteCount);
+};
+
+// reader of bits from a byte array (the first bit is the most significant one)
+class BitReader
+{
+public:
+    // given bytes must exist for the whole life of the reader
+    BitReader(const uint8_t *data, uint64_t byteCount);
+
+    // read one bit, there must be some bits remaining
+    bool readBit();
+    // read given number of bits (at most 56), there must be enough bits remaining
+    uint64_t read(unsigned int bitCount);
+    // return given number of following bits (at most 56) without reading them
+    // missing bits at the end of data are returned as zeros
+    uint64_t peek(unsigned int bitCount);
+    // skip given number of bits (at most 56), there must be enough bits remaining
+    void skip(unsigned int bitCount);
+
+    // check if there are no more bits to read
+    bool isEmpty() const;
+    // return the number of bits not read yet
+    uint64_t getRemainBitCount() const;
+
+private:
+    const uint8_t *curByte; // next byte to be loaded to the word
+    const uint8_t *endByte;
+
+    uint64_t word; // bits are aligned to the most significant bit
+    unsigned int wordBitCount;
+
+    // load as many whole bytes to the word as possible
+    void refill();
+};
@@ -0,0 +1,202 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// The implementation of static canonical Huffman code.
+//------------------------------------------------------------------------------
+
+#include "canonical.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <functional>
+
+using std::priority_queue;
+using std::greater;
+using std::pair;
+using std::sort;
+using std::fill;
+using std::copy;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// compute Huffman code lengths of given frequencies (without any length limit)
+// it returns the number of symbols with each code length (index is the length)
+vector<uint16_t> computeLengthCounts(const uint64_t *symbolFreqs)
+{
+    // tree nodes are indexed, first MAX_SYMBOLS of them are leaves
+    vector<int> parents(2 * MAX_SYMBOLS, -1);
+    // min heap of (frequency, node index), node index makes the order deterministic
+    priority_queue<pair<uint64_t, int>, vector<pair<uint64_t, int>>, greater<>> nodes;
+
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        if (symbolFreqs[i] != 0) {
+            nodes.push({symbolFreqs[i], i});
+        }
+    }
+
+    vector<uint16_t> lengthCounts(MAX_SYMBOLS);
+    if (nodes.size() == 1) // a single symbol still needs one bit
+    {
+        lengthCounts[1] = 1;
+        return lengthCounts;
+    }
+
+    int nextNode = MAX_SYMBOLS;
+    while (nodes.size() > 1) // merge two least frequent nodes
+    {
+        pair<uint64_t, int> node1 = nodes.top(); nodes.pop();
+        pair<uint64_t, int> node2 = nodes.top(); nodes.pop();
+
+        parents[node1.second] = nextNode;
+        parents[node2.second] = nextNode;
+        nodes.push({node1.first + node2.first, nextNode});
+        nextNode++;
+    }
+
+    for (int i = 0; i < MAX_SYMBOLS; i++)
+    {
+        if (symbolFreqs[i] == 0) {
+            continue;
+        }
+
+        uint16_t length = 0;
+        for (int node = i; parents[node] != -1; node = parents[node]) {
+            length++;
+        }
+        lengthCounts[length]++;
+    }
+
+    return lengthCounts;
+}
+
+// limit code lengths to the maximum length (while keeping the code complete)
+// each longest code pair is replaced by a code one bit shorter, and a shorter
+// code is split to make place for the other code of the pair
+void limitLengthCounts(vector<uint16_t> &lengthCounts)
+{
+    for (unsigned int i = lengthCounts.size() - 1; i > MAX_CODE_LENGTH; i--)
+    {
+        while (lengthCounts[i] > 0)
+        {
+            unsigned int j = i - 2;
+            while (lengthCounts[j] == 0) {
+                j--;
+            }
+
+            lengthCounts[i] -= 2;
+            lengthCounts[i - 1]++;
+            lengthCounts[j + 1] += 2;
+            lengthCounts[j]--;
+        }
+    }
+}
+
+// -------------------------- PUBLIC -------------------------------------------
+
+void CanonHuffCode::build(const uint64_t *symbolFreqs)
+{
+    vector<uint16_t> lengthCounts = computeLengthCounts(symbolFreqs);
+    limitLengthCounts(lengthCounts);
+
+    // more frequent symbols get shorter codes
+    vector<int> symbols;
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        if (symbolFreqs[i] != 0) {
+            symbols.push_back(i);
+        }
+    }
+    sort(symbols.begin(), symbols.end(), [symbolFreqs](int a, int b) {
+        return symbolFreqs[a] != symbolFreqs[b] ? symbolFreqs[a] > symbolFreqs[b] : a < b;
+    });
+
+    fill(codeLengths, codeLengths + MAX_SYMBOLS, 0);
+    unsigned int length = 1;
+    for (int symbol : symbols)
+    {
+        while (lengthCounts[length] == 0) {
+            length++;
+        }
+        codeLengths[symbol] = length;
+        lengthCounts[length]--;
+    }
+
+    assignCodes();
+}
+
+bool CanonHuffCode::setCodeLengths(const uint8_t *lengths)
+{
+    // check Kraft inequality (any valid prefix code must meet it)
+    uint64_t codeSpace = 0;
+    for (int i = 0; i < MAX_SYMBOLS; i++)
+    {
+        if (lengths[i] > MAX_CODE_LENGTH) {
+            return false;
+        }
+        if (lengths[i] != 0) {
+            codeSpace += uint64_t(1) << (MAX_CODE_LENGTH - lengths[i]);
+        }
+    }
+    if (codeSpace > (uint64_t(1) << MAX_CODE_LENGTH)) {
+        return false;
+    }
+
+    copy(lengths, lengths + MAX_SYMBOLS, codeLengths);
+    assignCodes();
+    return true;
+}
+
+const uint8_t* CanonHuffCode::getCodeLengths() const {
+    return codeLengths;
+}
+
+void CanonHuffCode::encode(uint8_t symbol, BitWriter &writer) const {
+    writer.write(codes[symbol], codeLengths[symbol]);
+}
+
+int CanonHuffCode::decode(BitReader &reader) const
+{
+    // missing bits at the end are zeros, so also check the actual code length
+    uint16_t entry = decodeTable[reader.peek(MAX_CODE_LENGTH)];
+    unsigned int length = entry >> BITS_IN_SYMBOL;
+    if (length == 0 || length > reader.getRemainBitCount()) {
+        return -1;
+    }
+
+    reader.skip(length);
+    return entry & 0xff;
+}
+
+// -------------------------- PRIVATE ------------------------------------------
+
+void CanonHuffCode::assignCodes()
+{
+    // the first code of each length follows the last code of the shorter length
+    uint16_t nextCodes[MAX_CODE_LENGTH + 1] = {};
+    uint16_t lengthCounts[MAX_CODE_LENGTH + 1] = {};
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        lengthCounts[codeLengths[i]]++;
+    }
+    lengthCounts[0] = 0;
+    for (int length = 1; length <= MAX_CODE_LENGTH; length++) {
+        nextCodes[length] = (nextCodes[length - 1] + lengthCounts[length - 1]) << 1;
+    }
+
+    decodeTable.assign(1 << MAX_CODE_LENGTH, 0); // zero length for invalid codes
+    for (int i = 0; i < MAX_SYMBOLS; i++)
+    {
+        unsigned int length = codeLengths[i];
+        if (length == 0) {
+            continue;
+        }
+        codes[i] = nextCodes[length]++;
+
+        // all entries starting with the code belong to the symbol
+        unsigned int firstIndex = codes[i] << (MAX_CODE_LENGTH - length);
+        unsigned int entryCount = 1 << (MAX_CODE_LENGTH - length);
+        for (unsigned int j = firstIndex; j < firstIndex + entryCount; j++) {
+            decodeTable[j] = (length << BITS_IN_SYMBOL) | i;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file for static canonical Huffman code.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "huffman.hpp"
+#include "bitstream.hpp"
+
+using std::vector;
+
+#define MAX_CODE_LENGTH 12 // limit of code lengths (also the decode table size)
+#define CODE_LENGTH_BITS 4 // number of bits to store one code length
+
+
+// canonical Huffman code, codes of the same length are assigned in the order
+// of symbols, so the code is fully described just by code lengths of symbols
+class CanonHuffCode
+{
+public:
+    // build the code from given frequencies of all symbols
+    void build(const uint64_t *symbolFreqs);
+    // set up the code from given code lengths of all symbols
+    // it returns false when the lengths do not describe a valid code
+    bool setCodeLengths(const uint8_t *lengths);
+    // return code lengths of all symbols (zero for unused symbols)
+    const uint8_t* getCodeLengths() const;
+
+    // encode given symbol (it must be used) and write its code
+    void encode(uint8_t symbol, BitWriter &writer) const;
+    // decode one symbol from given code
+    // return -1 when unexpected end of input stream or invalid code
+    int decode(BitReader &reader) const;
+
+private:
+    uint8_t codeLengths[MAX_SYMBOLS];
+    uint16_t codes[MAX_SYMBOLS];
+
+    // decode table indexed by the following code bits
+    // entries include symbol (lower byte) and code length (upper byte)
+    vector<uint16_t> decodeTable;
+
+    // assign canonical codes based on code lengths and build the decode table
+    void assignCodes();
+};
@@ -0,0 +1,540 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of functions working with data split to independent chunks.
+//------------------------------------------------------------------------------
+
+#include "chunks.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+#include "transform.hpp"
+#include "headers.hpp"
+#include "error.hpp"
+
+using std::min;
+using std::max;
+using std::memcpy;
+using std::get;
+using std::tuple;
+using std::make_tuple;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// location of one chunk in chunked data
+struct ChunkInfo
+{
+    uint64_t dataIndex; // index of packed chunk data (after its header)
+    uint32_t packedSize;
+    uint32_t rawSize;
+    bool rawStored;
+    uint64_t rawIndex = 0; // index of raw chunk data in decompressed data
+};
+
+// return the number of raw bytes in each chunk (except the last one)
+uint64_t getChunkRawSize(const CodecOptions &options)
+{
+    uint64_t chunkSize = options.chunkSize;
+
+    // chunks with 2D data must contain whole lines
+    if (options.uses2DData()) {
+        chunkSize = max(chunkSize / options.matrixWidth, uint64_t(1)) * options.matrixWidth;
+    }
+    // chunks with adaptive block RLE must also contain at least one whole block
+    if (options.useAdaptRLE)
+    {
+        uint64_t lineCount = max(chunkSize / options.matrixWidth, uint64_t(INIT_RLE_BLOCK_SIZE));
+        chunkSize = lineCount * options.matrixWidth;
+    }
+
+    if (chunkSize > MAX_CHUNK_SIZE) {
+        throw CodecError("too large chunks for given 2D data width", 19);
+    }
+
+    return chunkSize;
+}
+
+// parse chunk header at given index and check that the whole chunk is present
+// it returns chunk info (empty chunk at the end of data)
+ChunkInfo extractChunkInfo(const uint8_t *data, uint64_t size, uint64_t headerIndex)
+{
+    tuple<uint32_t, uint32_t, bool> chunkHeader = extractChunkHeader(
+        data + headerIndex, size - headerIndex);
+    uint64_t dataIndex = headerIndex + CHUNK_HEADER_SIZE;
+
+    ChunkInfo chunk = {dataIndex, get<0>(chunkHeader), get<1>(chunkHeader), get<2>(chunkHeader)};
+    if (chunk.packedSize > size - dataIndex || chunk.rawSize > MAX_CHUNK_SIZE) {
+        throw CodecError("unexpected end of chunk data", 20);
+    }
+
+    return chunk;
+}
+
+// find all chunks of given chunked data by their headers, they end at given index
+// (the seek index follows them, then its offsets must match the chunks)
+// it returns a tuple of:
+//   * all chunks (without the empty one at the end)
+//   * size of decompressed data
+tuple<vector<ChunkInfo>, uint64_t> findChunks(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t chunksEnd,
+    const vector<uint64_t> &chunkOffsets)
+{
+    vector<ChunkInfo> chunks;
+    uint64_t headerIndex = getHuffHeaderSize(data, size);
+    uint64_t rawSize = 0;
+    while (true)
+    {
+        ChunkInfo chunk = extractChunkInfo(data, chunksEnd, headerIndex);
+        if (chunk.packedSize == 0 && chunk.rawSize == 0) {
+            headerIndex = chunk.dataIndex;
+            break; // empty chunk at the end
+        }
+
+        bool isIndexed = chunks.size() < chunkOffsets.size() &&
+            chunkOffsets[chunks.size()] == headerIndex;
+        if (chunksEnd != size && !isIndexed) {
+            throw CodecError("invalid seek index", 27);
+        }
+
+        chunk.rawIndex = rawSize;
+        chunks.push_back(chunk);
+        rawSize += chunk.rawSize;
+        headerIndex = chunk.dataIndex + chunk.packedSize;
+    }
+
+    if (headerIndex != chunksEnd) {
+        throw CodecError("leftover chunk data detected", 21);
+    }
+    if (chunks.size() != chunkOffsets.size() && chunksEnd != size) {
+        throw CodecError("invalid seek index", 27);
+    }
+
+    return make_tuple(chunks, rawSize);
+}
+
+// find chunks covering requested range of decompressed data using seek index with
+// given offsets of chunks (only their headers are read), chunks end at given index
+// it returns a tuple of:
+//   * chunks covering the range
+//   * size of decompressed data
+tuple<vector<ChunkInfo>, uint64_t> findRangeChunks(
+    const uint8_t *data,
+    uint64_t chunksEnd,
+    uint64_t chunkSize,
+    const vector<uint64_t> &chunkOffsets,
+    const CodecOptions &options)
+{
+    if (chunkOffsets.empty()) {
+        return make_tuple(vector<ChunkInfo>(), uint64_t(0));
+    }
+    if (chunkSize == 0 || chunkSize > MAX_CHUNK_SIZE) {
+        throw CodecError("invalid seek index", 27);
+    }
+
+    // all chunks except the last one have the same size
+    uint64_t lastIndex = chunkOffsets.size() - 1;
+    ChunkInfo lastChunk = extractChunkInfo(data, chunksEnd, chunkOffsets[lastIndex]);
+    uint64_t rawSize = lastIndex * chunkSize + lastChunk.rawSize;
+
+    uint64_t rangeSize = getRangeSize(options, rawSize);
+    uint64_t firstChunk = options.rangeStart / chunkSize;
+    uint64_t endChunk = (options.rangeStart + rangeSize + chunkSize - 1) / chunkSize;
+
+    vector<ChunkInfo> chunks;
+    for (uint64_t i = firstChunk; i < endChunk; i++)
+    {
+        ChunkInfo chunk = extractChunkInfo(data, chunksEnd, chunkOffsets[i]);
+        uint64_t expectedSize = i < lastIndex ? chunkSize : lastChunk.rawSize;
+        if (chunk.rawSize != expectedSize || chunk.rawSize == 0) {
+            throw CodecError("invalid seek index", 27);
+        }
+
+        chunk.rawIndex = i * chunkSize;
+        chunks.push_back(chunk);
+    }
+
+    return make_tuple(chunks, rawSize);
+}
+
+// create Huffman header of chunked data, it only indicates chunks (and their size),
+// each chunk has its own header
+vector<uint8_t> createChunksHeader(uint64_t chunkSize, const CodecOptions &options)
+{
+    HuffHeader header;
+    header.byteCount = chunkSize;
+    header.chunksUsed = true;
+    header.seekIndexStored = options.useSeekIndex;
+    return createHuffHeader(header);
+}
+
+// compress one chunk of raw data, it returns chunk header followed by its data
+vector<uint8_t> compressChunk(
+    const uint8_t *rawData,
+    uint64_t rawSize,
+    const CodecOptions &options,
+    ThreadPool &threadPool)
+{
+    // too small last chunk is compressed with standard RLE
+    CodecOptions chunkOptions = options;
+    if (rawSize / options.matrixWidth < INIT_RLE_BLOCK_SIZE) {
+        chunkOptions.useAdaptRLE = false;
+    }
+
+    // chunks are compressed in parallel, so each one has its own buffers
+    CodecBuffers buffers;
+    buffers.rawData.assign(rawData, rawData + rawSize);
+    vector<uint8_t> chunkData;
+    compressStream(chunkOptions, threadPool, buffers, chunkData);
+
+    // store raw data if they cannot be compressed
+    bool rawStored = chunkData.size() >= rawSize;
+    if (rawStored) {
+        chunkData.assign(rawData, rawData + rawSize);
+    }
+
+    vector<uint8_t> packedChunk = createChunkHeader(chunkData.size(), rawSize, rawStored);
+    packedChunk.insert(packedChunk.end(), chunkData.begin(), chunkData.end());
+    return packedChunk;
+}
+
+// decompress one chunk (its packed data) to given target of its raw size
+void decompressChunk(
+    const ChunkInfo &chunk,
+    const uint8_t *chunkData,
+    uint8_t *outData,
+    const CodecOptions &options,
+    ThreadPool &threadPool)
+{
+    if (chunk.rawStored)
+    {
+        if (chunk.packedSize != chunk.rawSize) {
+            throw CodecError("invalid chunk contents", 22);
+        }
+        memcpy(outData, chunkData, chunk.rawSize);
+        return;
+    }
+
+    // decode straight to the target (its size is known from chunk header)
+    CodecBuffers buffers;
+    decompressStream(chunkData, chunk.packedSize, options, threadPool, buffers,
+        [&chunk, outData](uint64_t rawSize)
+        {
+            if (rawSize != chunk.rawSize) {
+                throw CodecError("invalid chunk contents", 22);
+            }
+            return outData;
+        });
+}
+
+// write given bytes to given output stream
+void writeBytes(ostream &os, const vector<uint8_t> &vec) {
+    os.write((const char *) vec.data(), vec.size());
+}
+
+// -------------------------- CHUNKS -------------------------------------------
+
+void compressChunks(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    vector<uint8_t> &outData)
+{
+    uint64_t chunkSize = getChunkRawSize(options);
+    uint64_t chunkCount = (size + chunkSize - 1) / chunkSize;
+
+    vector<vector<uint8_t>> packedChunks(chunkCount);
+    threadPool.parallelFor(chunkCount, [&](uint64_t i)
+    {
+        uint64_t rawSize = min(chunkSize, size - i * chunkSize);
+        packedChunks[i] = compressChunk(data + i * chunkSize, rawSize, options, threadPool);
+    });
+
+    vector<uint8_t> chunksHeader = createChunksHeader(chunkSize, options);
+    outData.assign(chunksHeader.begin(), chunksHeader.end());
+    vector<uint64_t> chunkOffsets;
+    for (const vector<uint8_t> &packedChunk : packedChunks)
+    {
+        chunkOffsets.push_back(outData.size());
+        outData.insert(outData.end(), packedChunk.begin(), packedChunk.end());
+    }
+
+    // empty chunk terminates the data
+    vector<uint8_t> endHeader = createChunkHeader(0, 0, false);
+    outData.insert(outData.end(), endHeader.begin(), endHeader.end());
+
+    if (options.useSeekIndex)
+    {
+        vector<uint8_t> seekIndex = createSeekIndex(chunkOffsets);
+        outData.insert(outData.end(), seekIndex.begin(), seekIndex.end());
+    }
+}
+
+uint64_t decompressChunks(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    const OutputAllocator &allocOutput)
+{
+    // each chunk is a separate 2D data, so no rectangle is cut out of them
+    if (options.usesRect()) {
+        throw CodecError("rectangle cannot be decompressed from chunks", 29);
+    }
+
+    // seek index (if any) follows the chunks
+    HuffHeader header = extractHuffHeader(data, size);
+    vector<uint64_t> chunkOffsets;
+    uint64_t chunksEnd = size;
+    if (header.seekIndexStored)
+    {
+        chunkOffsets = extractSeekIndex(data, size);
+        chunksEnd = size - (chunkOffsets.size() + 1) * SEEK_INDEX_ENTRY_SIZE;
+    }
+
+    // find chunks first, only the needed ones when they may be found using the index
+    tuple<vector<ChunkInfo>, uint64_t> chunksTuple = options.usesRange() && header.seekIndexStored ?
+        findRangeChunks(data, chunksEnd, header.byteCount, chunkOffsets, options) :
+        findChunks(data, size, chunksEnd, chunkOffsets);
+    const vector<ChunkInfo> &chunks = get<0>(chunksTuple);
+    uint64_t rawSize = get<1>(chunksTuple);
+
+    uint64_t rangeStart = options.rangeStart;
+    uint64_t rangeSize = getRangeSize(options, rawSize);
+    uint8_t *outData = allocOutput(rangeSize);
+
+    threadPool.parallelFor(chunks.size(), [&](uint64_t i)
+    {
+        const ChunkInfo &chunk = chunks[i];
+        uint64_t copyStart = max(chunk.rawIndex, rangeStart);
+        uint64_t copyEnd = min(chunk.rawIndex + chunk.rawSize, rangeStart + rangeSize);
+        if (copyStart >= copyEnd) {
+            return; // out of the range
+        }
+
+        // chunks within the range are decoded straight to the target
+        if (copyEnd - copyStart == chunk.rawSize)
+        {
+            decompressChunk(chunk, data + chunk.dataIndex,
+                outData + (chunk.rawIndex - rangeStart), options, threadPool);
+            return;
+        }
+
+        vector<uint8_t> rawChunk(chunk.rawSize);
+        decompressChunk(chunk, data + chunk.dataIndex, rawChunk.data(), options, threadPool);
+        memcpy(outData + (copyStart - rangeStart),
+            rawChunk.data() + (copyStart - chunk.rawIndex), copyEnd - copyStart);
+    });
+
+    return rangeSize;
+}
+
+uint64_t compressChunkStream(
+    istream &is,
+    ostream &os,
+    const CodecOptions &options,
+    ThreadPool &threadPool)
+{
+    uint64_t chunkSize = getChunkRawSize(options);
+    uint64_t windowChunkCount = threadPool.getThreadCount();
+
+    vector<uint8_t> header = createChunksHeader(chunkSize, options);
+    writeBytes(os, header);
+    uint64_t outSize = header.size();
+    vector<uint64_t> chunkOffsets;
+
+    // one window contains one chunk for each thread
+    vector<uint8_t> window(windowChunkCount * chunkSize);
+    vector<vector<uint8_t>> packedChunks(windowChunkCount);
+    uint64_t inSize = 0;
+    while (is)
+    {
+        // a window is always filled completely (except at the end), so chunks are the
+        // same as when compressing the whole data at once
+        StageTimer readTimer(options.stats);
+        is.read((char *) window.data(), window.size());
+        uint64_t windowSize = is.gcount();
+        inSize += windowSize;
+        readTimer.stop("read", windowSize, windowSize);
+
+        uint64_t chunkCount = (windowSize + chunkSize - 1) / chunkSize;
+        threadPool.parallelFor(chunkCount, [&](uint64_t i)
+        {
+            uint64_t rawSize = min(chunkSize, windowSize - i * chunkSize);
+            packedChunks[i] = compressChunk(
+                window.data() + i * chunkSize, rawSize, options, threadPool);
+        });
+
+        StageTimer writeTimer(options.stats);
+        uint64_t windowOutSize = 0;
+        for (uint64_t i = 0; i < chunkCount; i++)
+        {
+            chunkOffsets.push_back(outSize + windowOutSize);
+            writeBytes(os, packedChunks[i]);
+            windowOutSize += packedChunks[i].size();
+        }
+        outSize += windowOutSize;
+        writeTimer.stop("write", windowOutSize, windowOutSize);
+    }
+
+    // empty chunk terminates the data
+    vector<uint8_t> endHeader = createChunkHeader(0, 0, false);
+    writeBytes(os, endHeader);
+    outSize += endHeader.size();
+
+    if (options.useSeekIndex)
+    {
+        vector<uint8_t> seekIndex = createSeekIndex(chunkOffsets);
+        writeBytes(os, seekIndex);
+        outSize += seekIndex.size();
+    }
+
+    // the whole input must be valid 2D data (known only at the end)
+    if (options.uses2DData() && (inSize % options.matrixWidth) != 0) {
+        throw CodecError("invalid size of input 2D data detected", 6);
+    }
+
+    return outSize;
+}
+
+uint64_t decompressChunkStream(
+    istream &is,
+    ostream &os,
+    const HuffHeader &header,
+    const CodecOptions &options,
+    ThreadPool &threadPool)
+{
+    // each chunk is a separate 2D data, so no rectangle is cut out of them
+    if (options.usesRect()) {
+        throw CodecError("rectangle cannot be decompressed from chunks", 29);
+    }
+
+    // chunks are never larger than the chunk size, which bounds the allocated buffers
+    uint64_t chunkSize = header.byteCount;
+    if (chunkSize == 0 || chunkSize > MAX_CHUNK_SIZE) {
+        throw CodecError("invalid or missing chunk header", 18);
+    }
+
+    uint64_t windowChunkCount = threadPool.getThreadCount();
+    uint64_t rangeEnd = options.rangeStart + min(options.rangeSize, UINT64_MAX - options.rangeStart);
+
+    // one window contains one chunk for each thread
+    vector<vector<uint8_t>> packedChunks(windowChunkCount);
+    vector<ChunkInfo> chunks(windowChunkCount);
+    vector<vector<uint8_t>> rawChunks(windowChunkCount);
+    uint64_t outSize = 0;
+    uint64_t rawIndex = 0; // index of the next chunk in decompressed data
+    vector<uint64_t> chunkOffsets; // to check the seek index
+    uint64_t inOffset = createHuffHeader(header).size();
+    bool endReached = false;
+    while (!endReached && rawIndex < rangeEnd)
+    {
+        StageTimer readTimer(options.stats);
+        uint64_t windowInSize = 0;
+        uint64_t chunkCount = 0;
+        while (chunkCount < windowChunkCount)
+        {
+            // load chunk header, and then its data
+            vector<uint8_t> &packedChunk = packedChunks[chunkCount];
+            packedChunk.resize(CHUNK_HEADER_SIZE);
+            is.read((char *) packedChunk.data(), CHUNK_HEADER_SIZE);
+            tuple<uint32_t, uint32_t, bool> chunkHeader = extractChunkHeader(
+                packedChunk.data(), is.gcount());
+            uint32_t packedSize = get<0>(chunkHeader);
+            uint32_t rawSize = get<1>(chunkHeader);
+            if (packedSize > rawSize || rawSize > chunkSize) { // raw data are stored otherwise
+                throw CodecError("invalid or missing chunk header", 18);
+            }
+
+            // the buffer grows only with data actually read, so it is bounded by the input
+            uint64_t readSize = 0;
+            while (readSize < packedSize && !is.fail())
+            {
+                uint64_t stepSize = min(packedSize - readSize, max(readSize, CHUNK_READ_STEP));
+                packedChunk.resize(CHUNK_HEADER_SIZE + readSize + stepSize);
+                is.read((char *) packedChunk.data() + CHUNK_HEADER_SIZE + readSize, stepSize);
+                readSize += is.gcount();
+            }
+            packedChunk.resize(CHUNK_HEADER_SIZE + readSize);
+            ChunkInfo chunk = extractChunkInfo(packedChunk.data(), packedChunk.size(), 0);
+            windowInSize += packedChunk.size();
+
+            if (chunk.packedSize == 0 && chunk.rawSize == 0)
+            {
+                endReached = true; // empty chunk at the end
+                break;
+            }
+            chunkOffsets.push_back(inOffset);
+            inOffset += packedChunk.size();
+            chunk.rawIndex = rawIndex;
+            rawIndex += chunk.rawSize;
+            chunks[chunkCount++] = chunk;
+        }
+        readTimer.stop("read", windowInSize, windowInSize);
+
+        // chunks out of the requested range are skipped
+        auto getCopyStart = [&](const ChunkInfo &chunk) {
+            return max(chunk.rawIndex, options.rangeStart);
+        };
+        auto getCopyEnd = [&](const ChunkInfo &chunk) {
+            return min(chunk.rawIndex + chunk.rawSize, rangeEnd);
+        };
+
+        threadPool.parallelFor(chunkCount, [&](uint64_t i)
+        {
+            rawChunks[i].clear();
+            if (getCopyStart(chunks[i]) >= getCopyEnd(chunks[i])) {
+                return;
+            }
+
+            rawChunks[i].resize(chunks[i].rawSize);
+            decompressChunk(
+                chunks[i], packedChunks[i].data() + chunks[i].dataIndex,
+                rawChunks[i].data(), options, threadPool);
+        });
+
+        StageTimer writeTimer(options.stats);
+        uint64_t windowOutSize = 0;
+        for (uint64_t i = 0; i < chunkCount; i++)
+        {
+            uint64_t copyStart = getCopyStart(chunks[i]);
+            uint64_t copyEnd = getCopyEnd(chunks[i]);
+            if (copyStart < copyEnd)
+            {
+                os.write((const char *) rawChunks[i].data() + (copyStart - chunks[i].rawIndex),
+                    copyEnd - copyStart);
+                windowOutSize += copyEnd - copyStart;
+            }
+        }
+        outSize += windowOutSize;
+        writeTimer.stop("write", windowOutSize, windowOutSize);
+    }
+
+    // the rest of data is not needed for the range
+    if (!endReached) {
+        return outSize;
+    }
+    getRangeSize(options, rawIndex); // the range must not start after the data
+
+    // seek index is useless for streams, it must only match the read chunks
+    if (header.seekIndexStored)
+    {
+        vector<uint8_t> seekIndex = createSeekIndex(chunkOffsets);
+        vector<uint8_t> storedIndex(seekIndex.size());
+        is.read((char *) storedIndex.data(), storedIndex.size());
+        if (uint64_t(is.gcount()) != storedIndex.size() || storedIndex != seekIndex) {
+            throw CodecError("invalid seek index", 27);
+        }
+    }
+
+    if (is.peek() != istream::traits_type::eof()) {
+        throw CodecError("leftover chunk data detected", 21);
+    }
+
+    return outSize;
+}
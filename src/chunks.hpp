@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of functions working with data split to independent chunks.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#include "codec.hpp"
+#include "headers.hpp"
+#include "threadpool.hpp"
+
+using std::vector;
+using std::istream;
+using std::ostream;
+
+#define MAX_CHUNK_SIZE (uint64_t(1) << 30) // chunk sizes must fit to chunk header
+#define CHUNK_READ_STEP (uint64_t(1) << 20) // first step of reading chunks from streams
+
+
+// compress given data in chunks of configured size, each chunk is compressed as
+// an independent stream, so they are compressed in parallel
+// the output is the same for any number of threads
+// output parts: <Huffman-header>{<chunk-header><chunk-data>}<empty-chunk-header>[<seek-index>]
+// the seek index (if configured) locates chunks, so they may be decoded separately
+// compressed data replace the contents of given vector (its capacity is reused)
+void compressChunks(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    vector<uint8_t> &outData);
+// decompress given chunked data (chunks are decompressed in parallel) straight to
+// the target from given allocator, it returns the size of decompressed data
+// for a range of decompressed data, only chunks covering it are decompressed, and
+// with seek index, the other ones are not even read
+uint64_t decompressChunks(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    const OutputAllocator &allocOutput);
+
+// compress data from given input stream to given output stream in chunks
+// only a window with one chunk for each thread is held in memory at a time
+// the output is the same as when compressing the whole data at once
+// it returns the number of written bytes
+uint64_t compressChunkStream(
+    istream &is,
+    ostream &os,
+    const CodecOptions &options,
+    ThreadPool &threadPool);
+// decompress chunked data from given input stream (given Huffman header already
+// read) to given output stream, it also works in windows of chunks
+// for a range of decompressed data, chunks out of it are skipped, and the input is
+// read only up to the end of the range
+// it returns the number of written bytes
+uint64_t decompressChunkStream(
+    istream &is,
+    ostream &os,
+    const HuffHeader &header,
+    const CodecOptions &options,
+    ThreadPool &threadPool);
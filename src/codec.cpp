@@ -0,0 +1,420 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of the whole compression and decompression pipelines.
+//------------------------------------------------------------------------------
+
+#include "codec.hpp"
+
+#include <iterator>
+#include <tuple>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+#include "transform.hpp"
+#include "huffman.hpp"
+#include "headers.hpp"
+#include "chunks.hpp"
+#include "tiles.hpp"
+#include "error.hpp"
+
+using std::istreambuf_iterator;
+using std::tuple;
+using std::get;
+using std::min;
+using std::memcpy;
+
+
+void compressStream(
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    vector<uint8_t> &outData)
+{
+    vector<uint8_t> &inData = buffers.rawData;
+    vector<uint8_t> &rleData = buffers.rleData;
+
+    // check valid matrix size (only when using adaptive block RLE or predictors)
+    if (options.uses2DData() && (inData.size() % options.matrixWidth) != 0) {
+        throw CodecError("invalid size of input 2D data detected", 6);
+    }
+    uint64_t rawSize = inData.size();
+    uint64_t matrixHeight = rawSize / options.matrixWidth;
+
+    // perform required TRANSFORMATIONS (each of them is a stage for statistics)
+    if (options.useDiffModel)
+    {
+        StageTimer timer(options.stats);
+        applyDiffModel(inData);
+        timer.stop("differential model", rawSize, rawSize);
+    }
+    vector<uint8_t> rowPredictors;
+    if (options.predictor != PRED_NONE)
+    {
+        StageTimer timer(options.stats);
+        if (options.predictor == PRED_AUTO)
+        {
+            rowPredictors = selectRowPredictors(
+                inData, options.matrixWidth, matrixHeight, threadPool);
+            timer.stop("predictor selection", rawSize, rowPredictors.size());
+            timer = StageTimer(options.stats);
+        } else {
+            rowPredictors.assign(matrixHeight, options.predictor);
+        }
+        applyPredictors(inData, options.matrixWidth, matrixHeight, rowPredictors, threadPool);
+        timer.stop("2D predictors", rawSize, rawSize);
+    }
+    // rows of blocks of large 2D data are decoded in parallel
+    bool rowLengthsStored = options.useAdaptRLE && rawSize >= MIN_ROW_LENGTHS_SIZE;
+    StageTimer rleTimer(options.stats);
+    if (options.useAdaptRLE)
+    {
+        applyAdaptRLE(inData, options.matrixWidth, matrixHeight, rowLengthsStored,
+            rleData, threadPool, options.stats);
+        rleTimer.stop("adaptive block RLE", rawSize, rleData.size());
+    }
+    else
+    {
+        applyRLE(inData, rleData);
+        rleTimer.stop("RLE", rawSize, rleData.size());
+    }
+
+    // first header for Huffman coding
+    HuffHeader header;
+    header.byteCount = rleData.size();
+    header.diffModelUsed = options.useDiffModel;
+    header.adaptRLEUsed = options.useAdaptRLE;
+    header.vitterUsed = options.useVitter;
+    header.staticUsed = options.useStatic;
+    header.rawSizeStored = true;
+    header.rawSize = rawSize;
+    header.predictorUsed = options.predictor != PRED_NONE;
+    header.contextsUsed = options.useContexts;
+    header.rescalingUsed = !options.useStatic && rleData.size() >= MAX_ROOT_FREQ; // trees may be rescaled
+    header.rowLengthsStored = rowLengthsStored;
+    vector<uint8_t> huffHeader = createHuffHeader(header);
+    outData.assign(huffHeader.begin(), huffHeader.end());
+    if (options.predictor != PRED_NONE)
+    {
+        vector<uint8_t> predHeader = createPredHeader(
+            options.predictor, options.matrixWidth, rowPredictors);
+        outData.insert(outData.end(), predHeader.begin(), predHeader.end());
+    }
+
+    // then data; the bits are packed to bytes directly after the header
+    StageTimer huffTimer(options.stats);
+    uint64_t headerSize = outData.size();
+    BitWriter bitWriter(outData);
+    if (options.useStatic)
+    {
+        applyStaticHuffman(rleData, bitWriter, options.stats);
+        huffTimer.stop("static Huffman", rleData.size(), outData.size() - headerSize);
+    }
+    else
+    {
+        applyHuffman(
+            rleData, options.useVitter, options.useContexts, bitWriter, options.stats);
+        huffTimer.stop("adaptive Huffman", rleData.size(), outData.size() - headerSize);
+    }
+}
+
+uint64_t decompressStream(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    const OutputAllocator &allocOutput)
+{
+    HuffHeader header = extractHuffHeader(data, size);
+    if (header.chunksUsed || header.tilesUsed) { // chunks cannot be nested, tiles differ
+        throw CodecError("invalid Huffman coding header", 8);
+    }
+
+    uint64_t headerSize = getHuffHeaderSize(data, size);
+
+    // sizes from the header are limited by the data (each symbol has at least one bit,
+    // and each RLE byte is decoded to at most 255 bytes), so corrupted ones are detected
+    // before allocating memory for them
+    if (header.byteCount > (size - headerSize) * CHAR_BIT) {
+        throw CodecError("invalid Huffman coding file contents", 9);
+    }
+    // frequencies of older streams (never rescaled) must fit to the trees
+    if (!header.staticUsed && !header.rescalingUsed && header.byteCount > UINT32_MAX) {
+        throw CodecError("invalid Huffman coding file contents", 9);
+    }
+    uint64_t maxRawSize = header.byteCount * UINT8_MAX;
+    if (header.rawSize > maxRawSize) {
+        throw CodecError("invalid size of decompressed data", 23);
+    }
+
+    // 2D predictors have their own header (they need the raw size)
+    uint64_t matrixWidth = 0;
+    vector<uint8_t> rowPredictors;
+    if (header.predictorUsed)
+    {
+        if (!header.rawSizeStored) {
+            throw CodecError("invalid Huffman coding header", 8);
+        }
+
+        tuple<uint64_t, vector<uint8_t>, uint64_t> predTuple = extractPredHeader(
+            data + headerSize, size - headerSize, header.rawSize);
+        matrixWidth = get<0>(predTuple);
+        rowPredictors = get<1>(predTuple);
+        headerSize += get<2>(predTuple);
+    }
+
+    // revert appropriate TRANSFORMATIONS (the bits stay packed in bytes)
+    StageTimer huffTimer(options.stats);
+    BitReader bitReader(data + headerSize, size - headerSize);
+    vector<uint8_t> &huffDecoded = buffers.rleData;
+    if (header.staticUsed)
+    {
+        revertStaticHuffman(bitReader, header.byteCount, huffDecoded, options.stats);
+        huffTimer.stop("static Huffman", size - headerSize, huffDecoded.size());
+    }
+    else
+    {
+        revertHuffman(bitReader, header.byteCount, header.vitterUsed, header.contextsUsed,
+            header.rescalingUsed, options.useDecodeTable, huffDecoded, options.stats);
+        huffTimer.stop("adaptive Huffman", size - headerSize, huffDecoded.size());
+    }
+
+    // the raw size must be found out for older streams
+    uint64_t rawSize = header.rawSize;
+    if (!header.rawSizeStored)
+    {
+        rawSize = header.adaptRLEUsed ?
+            getAdaptRLERawSize(huffDecoded.data(), huffDecoded.size()) :
+            getRLERawSize(huffDecoded.data(), huffDecoded.size());
+
+        if (rawSize > maxRawSize) {
+            throw CodecError("invalid size of decompressed data", 23);
+        }
+    }
+
+    // a rectangle is cut out of the whole 2D data, they have no restart points
+    vector<uint8_t> &matrix = buffers.rawData;
+    uint8_t *outData;
+    if (options.usesRect())
+    {
+        if (header.adaptRLEUsed && !header.predictorUsed) {
+            matrixWidth = get<0>(extractAdaptRLEHeader(huffDecoded.data(), huffDecoded.size()));
+        }
+        if (matrixWidth == 0) {
+            throw CodecError("rectangle can be decompressed only from 2D data", 29);
+        }
+        checkRect(options, matrixWidth, rawSize / matrixWidth);
+
+        matrix.resize(rawSize);
+        outData = matrix.data();
+    } else {
+        outData = allocOutput(rawSize);
+    }
+
+    StageTimer rleTimer(options.stats);
+    if (header.adaptRLEUsed)
+    {
+        revertAdaptRLE(huffDecoded.data(), huffDecoded.size(), outData, rawSize,
+            header.rowLengthsStored, threadPool, options.stats);
+        rleTimer.stop("adaptive block RLE", huffDecoded.size(), rawSize);
+    }
+    else
+    {
+        revertRLE(huffDecoded.data(), huffDecoded.size(), outData, rawSize);
+        rleTimer.stop("RLE", huffDecoded.size(), rawSize);
+    }
+    if (header.predictorUsed)
+    {
+        StageTimer timer(options.stats);
+        revertPredictors(outData, matrixWidth, rowPredictors.size(), rowPredictors);
+        timer.stop("2D predictors", rawSize, rawSize);
+    }
+    if (header.diffModelUsed)
+    {
+        StageTimer timer(options.stats);
+        revertDiffModel(outData, rawSize);
+        timer.stop("differential model", rawSize, rawSize);
+    }
+
+    if (!options.usesRect()) {
+        return rawSize;
+    }
+
+    uint64_t rectSize = options.rectWidth * options.rectHeight;
+    copyRect(options, outData, matrixWidth, 0, allocOutput(rectSize));
+    return rectSize;
+}
+
+uint64_t getRangeSize(const CodecOptions &options, uint64_t rawSize)
+{
+    if (options.rangeStart > rawSize) {
+        throw CodecError("range starts after the end of decompressed data", 28);
+    }
+    return min(options.rangeSize, rawSize - options.rangeStart);
+}
+
+void checkRect(const CodecOptions &options, uint64_t matrixWidth, uint64_t matrixHeight)
+{
+    if (options.rectX > matrixWidth || options.rectWidth > matrixWidth - options.rectX ||
+        options.rectY > matrixHeight || options.rectHeight > matrixHeight - options.rectY)
+    {
+        throw CodecError("rectangle lies out of 2D data", 29);
+    }
+}
+
+void copyRect(
+    const CodecOptions &options,
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t firstLine,
+    uint8_t *tarData)
+{
+    for (uint64_t y = 0; y < options.rectHeight; y++)
+    {
+        const uint8_t *line = matrix + (options.rectY + y - firstLine) * matrixWidth;
+        memcpy(tarData + y * options.rectWidth, line + options.rectX, options.rectWidth);
+    }
+}
+
+// decompress given single stream (tiled or not) straight to the target from given
+// allocator, it returns the size of decompressed data
+uint64_t decompressSingle(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    const OutputAllocator &allocOutput)
+{
+    if (extractHuffHeader(data, size).tilesUsed) {
+        return decompressTiles(data, size, options, threadPool, allocOutput);
+    }
+    return decompressStream(data, size, options, threadPool, buffers, allocOutput);
+}
+
+void huffCompress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    vector<uint8_t> &outData)
+{
+    if (options.useTiles)
+    {
+        compressTiles(data, size, options, threadPool, outData);
+        return;
+    }
+    if (options.chunkSize == 0)
+    {
+        buffers.rawData.assign(data, data + size);
+        compressStream(options, threadPool, buffers, outData);
+        return;
+    }
+
+    // the whole input must be valid 2D data, not only its chunks
+    if (options.uses2DData() && (size % options.matrixWidth) != 0) {
+        throw CodecError("invalid size of input 2D data detected", 6);
+    }
+    compressChunks(data, size, options, threadPool, outData);
+}
+
+uint64_t huffDecompress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    const OutputAllocator &allocOutput)
+{
+    if (extractHuffHeader(data, size).chunksUsed) {
+        return decompressChunks(data, size, options, threadPool, allocOutput);
+    }
+    if (!options.usesRange()) {
+        return decompressSingle(data, size, options, threadPool, buffers, allocOutput);
+    }
+
+    // a single stream is always decoded as a whole for a range (never with a rectangle)
+    vector<uint8_t> &rawData = buffers.rawData;
+    decompressSingle(data, size, options, threadPool, buffers, [&rawData](uint64_t rawSize)
+    {
+        rawData.resize(rawSize);
+        return rawData.data();
+    });
+    uint64_t rangeSize = getRangeSize(options, rawData.size());
+    memcpy(allocOutput(rangeSize), rawData.data() + options.rangeStart, rangeSize);
+    return rangeSize;
+}
+
+uint64_t huffCompressStream(
+    istream &is,
+    ostream &os,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers)
+{
+    if (options.chunkSize != 0) {
+        return compressChunkStream(is, os, options, threadPool);
+    }
+
+    // a single stream needs the whole input at once
+    StageTimer readTimer(options.stats);
+    vector<uint8_t> &inData = buffers.rawData;
+    inData.assign(istreambuf_iterator<char>(is), {});
+    readTimer.stop("read", inData.size(), inData.size());
+
+    vector<uint8_t> outData;
+    if (options.useTiles) {
+        compressTiles(inData.data(), inData.size(), options, threadPool, outData);
+    } else {
+        compressStream(options, threadPool, buffers, outData);
+    }
+
+    StageTimer writeTimer(options.stats);
+    os.write((const char *) outData.data(), outData.size());
+    writeTimer.stop("write", outData.size(), outData.size());
+    return outData.size();
+}
+
+uint64_t huffDecompressStream(
+    istream &is,
+    ostream &os,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers)
+{
+    // the header decides whether the data may be streamed
+    vector<uint8_t> inData(HUFF_HEADER_SIZE);
+    is.read((char *) inData.data(), HUFF_HEADER_SIZE);
+    inData.resize(is.gcount());
+    uint64_t headerSize = getHuffHeaderSize(inData.data(), inData.size());
+    inData.resize(headerSize);
+    is.read((char *) inData.data() + HUFF_HEADER_SIZE, headerSize - HUFF_HEADER_SIZE);
+    inData.resize(HUFF_HEADER_SIZE + is.gcount());
+    HuffHeader header = extractHuffHeader(inData.data(), inData.size());
+    if (header.chunksUsed) {
+        return decompressChunkStream(is, os, header, options, threadPool);
+    }
+
+    StageTimer readTimer(options.stats);
+    inData.insert(inData.end(), istreambuf_iterator<char>(is), {});
+    readTimer.stop("read", inData.size(), inData.size());
+
+    // the output cannot be one of the buffers, which hold the whole data for a rectangle
+    vector<uint8_t> outData;
+    decompressSingle(inData.data(), inData.size(), options, threadPool, buffers,
+        [&outData](uint64_t rawSize)
+        {
+            outData.resize(rawSize);
+            return outData.data();
+        });
+    uint64_t rangeSize = getRangeSize(options, outData.size());
+
+    StageTimer writeTimer(options.stats);
+    os.write((const char *) outData.data() + options.rangeStart, rangeSize);
+    writeTimer.stop("write", rangeSize, rangeSize);
+    return rangeSize;
+}
@@ -0,0 +1,149 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of the whole compression and decompression pipelines.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <functional>
+
+#include "threadpool.hpp"
+#include "predictor.hpp"
+#include "stats.hpp"
+
+using std::vector;
+using std::istream;
+using std::ostream;
+using std::function;
+
+
+#define DEFAULT_STREAM_CHUNK_SIZE (uint64_t(1) << 20) // chunk size for piped input
+#define MIN_ROW_LENGTHS_SIZE (uint64_t(1) << 20) // smaller 2D data are decoded serially
+
+// options of compression and decompression
+struct CodecOptions
+{
+    bool useDiffModel = false;
+    bool useAdaptRLE = false;
+    bool useVitter = false;
+    bool useStatic = false;
+    bool useContexts = false; // order-1 context modelling (adaptive Huffman only)
+    bool useTiles = false; // code rows of blocks independently (adaptive block RLE only)
+    Predictor predictor = PRED_NONE; // 2D predictor (instead of differential model)
+    uint64_t matrixWidth = 512; // width of 2D data (adaptive block RLE and predictors)
+
+    uint64_t chunkSize = 0; // size of independent chunks (zero for no chunks)
+    bool useSeekIndex = false; // store seek index of chunks (chunked compression only)
+    bool useDecodeTable = true; // decompression only
+    uint64_t rangeStart = 0; // range of decompressed bytes to output (decompression only)
+    uint64_t rangeSize = UINT64_MAX; // the whole data by default
+    uint64_t rectX = 0; // rectangle of decompressed 2D data to output (decompression only)
+    uint64_t rectY = 0;
+    uint64_t rectWidth = 0; // the whole data by default
+    uint64_t rectHeight = 0;
+
+    CodecStats *stats = nullptr; // collected statistics (nothing is measured when null)
+
+    // return whether input data must be 2D data (of whole lines)
+    bool uses2DData() const {
+        return useAdaptRLE || predictor != PRED_NONE;
+    }
+    // return whether only a range of decompressed data is requested
+    bool usesRange() const {
+        return rangeStart != 0 || rangeSize != UINT64_MAX;
+    }
+    // return whether only a rectangle of decompressed 2D data is requested
+    bool usesRect() const {
+        return rectWidth != 0 || rectHeight != 0;
+    }
+};
+
+// allocator of decompressed data, it returns a target for data of given size
+using OutputAllocator = function<uint8_t *(uint64_t size)>;
+
+// scratch buffers of the pipeline of a single stream, they may be kept across calls,
+// so their capacity is reused (they are not shared by parallel chunks)
+struct CodecBuffers
+{
+    vector<uint8_t> rawData; // raw data to compress (transformed in situ), or whole
+                             // decompressed data for a range or a rectangle
+    vector<uint8_t> rleData; // RLE data, input of Huffman coding or its output
+};
+
+// compress raw data of given buffers based on given options, as a single stream
+// (no chunks), the raw data are consumed, since transformations are performed in situ
+// compressed data replace the contents of given vector (its capacity is reused)
+// the pool is used by the transformations (serially when called from its loop)
+void compressStream(
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    vector<uint8_t> &outData);
+// decompress given single stream (based on its header) straight to the target
+// from given allocator, it returns the size of decompressed data
+// for a rectangle of 2D data, the whole data are decompressed and it is cut out
+// the pool is used by the transformations (serially when called from its loop)
+uint64_t decompressStream(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    const OutputAllocator &allocOutput);
+
+// return the size of requested range of decompressed data of given size, the range
+// is clipped to the data (it must not start after their end)
+uint64_t getRangeSize(const CodecOptions &options, uint64_t rawSize);
+// check that the requested rectangle lies within 2D data of given dimensions
+void checkRect(const CodecOptions &options, uint64_t matrixWidth, uint64_t matrixHeight);
+// copy the requested rectangle of given 2D data to given target, the data hold whole
+// lines starting at given line (all lines of the rectangle must be there)
+void copyRect(
+    const CodecOptions &options,
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t firstLine,
+    uint8_t *tarData);
+
+// compress given data based on given options (chunks are compressed in parallel)
+// compressed data replace the contents of given vector (its capacity is reused)
+void huffCompress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    vector<uint8_t> &outData);
+// decompress given data (based on its header, chunks are decompressed in parallel)
+// straight to the target from given allocator, it returns the size of decompressed data
+uint64_t huffDecompress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers,
+    const OutputAllocator &allocOutput);
+
+// compress data from given input stream to given output stream, chunks are
+// processed in windows, so the memory usage is bounded (without chunks, the
+// whole input is loaded), it returns the number of written bytes
+uint64_t huffCompressStream(
+    istream &is,
+    ostream &os,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers);
+// decompress data from given input stream to given output stream, chunked data
+// are processed in windows, it returns the number of written bytes
+uint64_t huffDecompressStream(
+    istream &is,
+    ostream &os,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    CodecBuffers &buffers);
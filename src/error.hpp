@@ -0,0 +1,32 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of errors reported by the codec.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+using std::runtime_error;
+using std::string;
+
+
+// error of compression or decompression (e.g., invalid data)
+// it is thrown inside of the codec and turned to a result by its API
+class CodecError : public runtime_error
+{
+public:
+    // error with given message and code (also used as exit code of the CLI)
+    CodecError(const string &message, int code) : runtime_error(message), code(code) {}
+
+    // return code of the error (never zero)
+    int getCode() const {
+        return code;
+    }
+
+private:
+    int code;
+};
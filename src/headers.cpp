@@ -8,18 +8,22 @@
 #include "headers.hpp"
 
 #include <climits>
-#include <iostream>
 
 #include "transform.hpp"
+#include "canonical.hpp"
+#include "predictor.hpp"
+#include "error.hpp"
 
-using std::cerr;
+using std::make_tuple;
 
 
 vector<uint8_t> createAdaptRLEHeader(
     uint64_t matrixWidth,
     uint64_t matrixHeight,
     uint64_t blockSize,
-    vector<bool> scanDirs)
+    vector<bool> scanDirs,
+    const vector<uint64_t> &rowLengths,
+    const vector<TileRowOffsets> &rowOffsets)
 {
     vector<uint8_t> finalVec;
 
@@ -59,67 +63,437 @@ vector<uint8_t> createAdaptRLEHeader(
         finalVec.push_back(curByte);
     }
 
+    // header part {<varint-row-length>} for each row of blocks, the lowest 7 bits first
+    for (uint64_t rowLength : rowLengths)
+    {
+        while (rowLength >= 0x80)
+        {
+            finalVec.push_back(0x80 | (rowLength & 0x7f));
+            rowLength >>= 7;
+        }
+        finalVec.push_back(rowLength);
+    }
+
+    // header part {<64b-data-offset><64b-packed-offset>} for each row of blocks
+    for (const TileRowOffsets &offsets : rowOffsets)
+    {
+        for (unsigned int i = sizeof(uint64_t); i > 0; i--) {
+            finalVec.push_back(offsets.dataOffset >> (CHAR_BIT * (i - 1)));
+        }
+        for (unsigned int i = sizeof(uint64_t); i > 0; i--) {
+            finalVec.push_back(offsets.packedOffset >> (CHAR_BIT * (i - 1)));
+        }
+    }
+
     return finalVec;
 }
 
-tuple<uint64_t, uint64_t, uint64_t, vector<bool>> extractAdaptRLEHeader(deque<uint8_t> &deq)
+tuple<uint64_t, uint64_t, uint64_t, vector<bool>, vector<uint64_t>, vector<TileRowOffsets>, uint64_t>
+extractAdaptRLEHeader(const uint8_t *data, uint64_t size, bool rowLengthsStored, bool tilesUsed)
 {
-    if (deq.size() < 3 * sizeof(uint64_t))
-    {
-        cerr << "ERROR: invalid or missing adaptive block RLE header\n";
-        exit(10);
+    if (size < 3 * sizeof(uint64_t)) {
+        throw CodecError("invalid or missing adaptive block RLE header", 10);
     }
 
     uint64_t matrixWidth = 0;
     uint64_t matrixHeight = 0;
     uint64_t blockSize = 0;
+    uint64_t index = 0;
     for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
-        matrixWidth = (matrixWidth << CHAR_BIT) | deq.front(); deq.pop_front();
+        matrixWidth = (matrixWidth << CHAR_BIT) | data[index++];
     }
     for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
-        matrixHeight = (matrixHeight << CHAR_BIT) | deq.front(); deq.pop_front();
+        matrixHeight = (matrixHeight << CHAR_BIT) | data[index++];
     }
     for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
-        blockSize = (blockSize << CHAR_BIT) | deq.front(); deq.pop_front();
+        blockSize = (blockSize << CHAR_BIT) | data[index++];
+    }
+    if (blockSize == 0) {
+        throw CodecError("invalid adaptive block RLE header", 11);
     }
     uint64_t blockCount = getBlockCount(matrixWidth, matrixHeight, blockSize);
 
     // read block scan directions
     vector<bool> scanDirs;
-    uint8_t curByte;
+    uint8_t curByte = 0;
     for (uint64_t i = 0; i < blockCount; i++)
     {
         if (i % CHAR_BIT == 0)
         {
-            if (deq.empty())
-            {
-                cerr << "ERROR: invalid adaptive block RLE header\n";
-                exit(11);
+            if (index == size) {
+                throw CodecError("invalid adaptive block RLE header", 11);
             }
-            curByte = deq.front(); deq.pop_front();
+            curByte = data[index++];
         }
         scanDirs.push_back((curByte >> (CHAR_BIT - (i % CHAR_BIT) - 1)) & 0x01);
     }
 
-    return make_tuple(matrixWidth, matrixHeight, blockSize, scanDirs);
+    // read lengths of rows of blocks, they are summed to indices of rows, which are
+    // limited by the given data (so they cannot overflow)
+    vector<uint64_t> rowIndices;
+    if (rowLengthsStored)
+    {
+        rowIndices.push_back(0);
+        uint64_t rowCount = getBlockRowCount(matrixHeight, blockSize);
+        for (uint64_t i = 0; i < rowCount; i++)
+        {
+            uint64_t rowLength = 0;
+            unsigned int shift = 0;
+            uint8_t varByte;
+            do {
+                if (index == size || shift >= 63) {
+                    throw CodecError("invalid adaptive block RLE header", 11);
+                }
+                varByte = data[index++];
+                rowLength |= uint64_t(varByte & 0x7f) << shift;
+                shift += 7;
+            } while (varByte & 0x80);
+
+            if (rowLength > size - rowIndices.back()) {
+                throw CodecError("invalid adaptive block RLE header", 11);
+            }
+            rowIndices.push_back(rowIndices.back() + rowLength);
+        }
+    }
+
+    // read offsets of rows of blocks (tiled data only)
+    vector<TileRowOffsets> rowOffsets;
+    if (tilesUsed)
+    {
+        uint64_t rowCount = getBlockRowCount(matrixHeight, blockSize);
+        if ((size - index) / (2 * sizeof(uint64_t)) < rowCount) {
+            throw CodecError("invalid adaptive block RLE header", 11);
+        }
+
+        TileRowOffsets prevOffsets = {0, 0}; // the first row starts at zero
+        for (uint64_t i = 0; i < rowCount; i++)
+        {
+            TileRowOffsets offsets = {0, 0};
+            for (unsigned int j = 0; j < sizeof(uint64_t); j++) {
+                offsets.dataOffset = (offsets.dataOffset << CHAR_BIT) | data[index++];
+            }
+            for (unsigned int j = 0; j < sizeof(uint64_t); j++) {
+                offsets.packedOffset = (offsets.packedOffset << CHAR_BIT) | data[index++];
+            }
+
+            bool isFirstValid = i != 0 || (offsets.dataOffset == 0 && offsets.packedOffset == 0);
+            if (!isFirstValid || offsets.dataOffset < prevOffsets.dataOffset ||
+                offsets.packedOffset < prevOffsets.packedOffset)
+            {
+                throw CodecError("invalid adaptive block RLE header", 11);
+            }
+            rowOffsets.push_back(offsets);
+            prevOffsets = offsets;
+        }
+    }
+
+    return make_tuple(matrixWidth, matrixHeight, blockSize, scanDirs, rowIndices, rowOffsets, index);
 }
 
-vector<uint8_t> createHuffHeader(uint64_t byteCount, bool useDiffModel, bool useAdaptRLE)
+vector<uint8_t> createStaticHuffHeader(const uint8_t *codeLengths)
+{
+    vector<uint8_t> finalVec;
+
+    // header part <4b-code-length> for each symbol, two of them in one byte
+    for (int i = 0; i < MAX_SYMBOLS; i += 2) {
+        finalVec.push_back(codeLengths[i] << CODE_LENGTH_BITS | codeLengths[i + 1]);
+    }
+
+    return finalVec;
+}
+
+vector<uint8_t> extractStaticHuffHeader(BitReader &reader)
+{
+    if (reader.getRemainBitCount() < MAX_SYMBOLS * CODE_LENGTH_BITS) {
+        throw CodecError("invalid or missing static Huffman header", 16);
+    }
+
+    vector<uint8_t> codeLengths;
+    for (int i = 0; i < MAX_SYMBOLS; i++) {
+        codeLengths.push_back(reader.read(CODE_LENGTH_BITS));
+    }
+
+    return codeLengths;
+}
+
+vector<uint8_t> createPredHeader(
+    uint8_t predictor,
+    uint64_t matrixWidth,
+    const vector<uint8_t> &rowPredictors)
+{
+    // header part <8b-predictor> to indicate the predictor (or automatic selection)
+    vector<uint8_t> finalVec = {predictor};
+
+    // header part <64b-matrix-width> to indicate 2D data width
+    for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+        finalVec.push_back(matrixWidth >> (CHAR_BIT * i));
+    }
+
+    // header part <2b-row-predictor> for each row, four of them in one byte
+    if (predictor == PRED_AUTO)
+    {
+        BitWriter writer(finalVec);
+        for (uint8_t rowPredictor : rowPredictors) {
+            writer.write(rowPredictor, PRED_ROW_BITS);
+        }
+        writer.flush();
+    }
+
+    return finalVec;
+}
+
+tuple<uint64_t, vector<uint8_t>, uint64_t> extractPredHeader(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t rawSize)
+{
+    if (size < 1 + sizeof(uint64_t)) {
+        throw CodecError("invalid or missing 2D predictors header", 24);
+    }
+
+    uint8_t predictor = data[0];
+    uint64_t matrixWidth = 0;
+    for (unsigned int i = sizeof(uint64_t); i > 0; i--) {
+        matrixWidth = (matrixWidth << CHAR_BIT) | data[i];
+    }
+    uint64_t headerSize = 1 + sizeof(uint64_t);
+
+    if (predictor > PRED_AUTO || matrixWidth == 0 || rawSize % matrixWidth != 0) {
+        throw CodecError("invalid 2D predictors header", 25);
+    }
+    uint64_t matrixHeight = rawSize / matrixWidth;
+
+    // the same predictor is used for all rows, unless automatic selection is used
+    vector<uint8_t> rowPredictors(matrixHeight, predictor);
+    if (predictor == PRED_AUTO)
+    {
+        uint64_t rowsSize = (matrixHeight * PRED_ROW_BITS + CHAR_BIT - 1) / CHAR_BIT;
+        if (size - headerSize < rowsSize) {
+            throw CodecError("invalid or missing 2D predictors header", 24);
+        }
+
+        BitReader reader(data + headerSize, rowsSize);
+        for (uint8_t &rowPredictor : rowPredictors) {
+            rowPredictor = reader.read(PRED_ROW_BITS);
+        }
+        headerSize += rowsSize;
+    }
+
+    return make_tuple(matrixWidth, rowPredictors, headerSize);
+}
+
+vector<uint8_t> createHuffHeader(const HuffHeader &header)
 {
     vector<uint8_t> finalVec;
 
     // header part <64b-byte-count> to indicate total number of encoded bytes
     for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
-        finalVec.push_back(byteCount >> (CHAR_BIT * i));
+        finalVec.push_back(header.byteCount >> (CHAR_BIT * i));
     }
 
+    // extended flags are stored only when needed, so older readers see no change
+    bool extFlagsStored = header.contextsUsed || header.rescalingUsed ||
+        header.seekIndexStored || header.tilesUsed || header.rowLengthsStored;
+
     // flags
     finalVec.push_back(
         // header part <8b-flags> [x-------] to indicate whether diff model was used
-        uint8_t(useDiffModel) << 7 |
+        uint8_t(header.diffModelUsed) << 7 |
         // header part <8b-flags> [-x------] to indicate whether adaptive RLE was used
-        uint8_t(useAdaptRLE) << 6
+        uint8_t(header.adaptRLEUsed) << 6 |
+        // header part <8b-flags> [--x-----] to indicate whether Vitter algorithm was used
+        uint8_t(header.vitterUsed) << 5 |
+        // header part <8b-flags> [---x----] to indicate whether static Huffman was used
+        uint8_t(header.staticUsed) << 4 |
+        // header part <8b-flags> [----x---] to indicate whether data are split to chunks
+        uint8_t(header.chunksUsed) << 3 |
+        // header part <8b-flags> [-----x--] to indicate whether raw size is stored
+        uint8_t(header.rawSizeStored) << 2 |
+        // header part <8b-flags> [------x-] to indicate whether 2D predictors were used
+        uint8_t(header.predictorUsed) << 1 |
+        // header part <8b-flags> [-------x] to indicate whether extended flags follow
+        uint8_t(extFlagsStored)
     );
 
+    if (extFlagsStored)
+    {
+        finalVec.push_back(
+            // header part <8b-ext-flags> [x-------] to indicate whether contexts were used
+            uint8_t(header.contextsUsed) << 7 |
+            // header part <8b-ext-flags> [-x------] to indicate whether rescaling was used
+            uint8_t(header.rescalingUsed) << 6 |
+            // header part <8b-ext-flags> [--x-----] to indicate whether seek index is stored
+            uint8_t(header.seekIndexStored) << 5 |
+            // header part <8b-ext-flags> [---x----] to indicate whether tiles were used
+            uint8_t(header.tilesUsed) << 4 |
+            // header part <8b-ext-flags> [----x---] to indicate whether row lengths are stored
+            uint8_t(header.rowLengthsStored) << 3
+        );
+    }
+
+    // header part <64b-raw-size> to indicate size of decompressed data
+    if (header.rawSizeStored)
+    {
+        for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+            finalVec.push_back(header.rawSize >> (CHAR_BIT * i));
+        }
+    }
+
     return finalVec;
 }
+
+HuffHeader extractHuffHeader(const uint8_t *data, uint64_t size)
+{
+    if (size < getHuffHeaderSize(data, size)) {
+        throw CodecError("invalid or missing Huffman coding header", 8);
+    }
+
+    HuffHeader header;
+    header.byteCount = 0;
+    for (unsigned int i = sizeof(uint64_t); i > 0; i--) {
+        header.byteCount = (header.byteCount << CHAR_BIT) | data[i - 1];
+    }
+
+    uint8_t flags = data[sizeof(uint64_t)];
+    header.diffModelUsed = (flags >> 7) & 0x01;
+    header.adaptRLEUsed = (flags >> 6) & 0x01;
+    header.vitterUsed = (flags >> 5) & 0x01;
+    header.staticUsed = (flags >> 4) & 0x01;
+    header.chunksUsed = (flags >> 3) & 0x01;
+    header.rawSizeStored = (flags >> 2) & 0x01;
+    header.predictorUsed = (flags >> 1) & 0x01;
+
+    uint64_t index = HUFF_HEADER_SIZE;
+    if (flags & 0x01) // extended flags
+    {
+        uint8_t extFlags = data[index++];
+        if ((extFlags & 0x07) != 0) { // unknown extended flags
+            throw CodecError("invalid Huffman coding header", 8);
+        }
+        header.contextsUsed = (extFlags >> 7) & 0x01;
+        header.rescalingUsed = (extFlags >> 6) & 0x01;
+        header.seekIndexStored = (extFlags >> 5) & 0x01;
+        header.tilesUsed = (extFlags >> 4) & 0x01;
+        header.rowLengthsStored = (extFlags >> 3) & 0x01;
+    }
+
+    header.rawSize = 0;
+    if (header.rawSizeStored)
+    {
+        for (unsigned int i = sizeof(uint64_t); i > 0; i--) {
+            header.rawSize = (header.rawSize << CHAR_BIT) | data[index + i - 1];
+        }
+    }
+
+    return header;
+}
+
+uint64_t getHuffHeaderSize(const uint8_t *data, uint64_t size)
+{
+    if (size < HUFF_HEADER_SIZE) {
+        throw CodecError("invalid or missing Huffman coding header", 8);
+    }
+
+    // extended flags and raw size are present only if indicated in flags
+    uint8_t flags = data[sizeof(uint64_t)];
+    bool rawSizeStored = (flags >> 2) & 0x01;
+    bool extFlagsStored = flags & 0x01;
+    return HUFF_HEADER_SIZE + extFlagsStored + (rawSizeStored ? sizeof(uint64_t) : 0);
+}
+
+vector<uint8_t> createChunkHeader(uint32_t packedSize, uint32_t rawSize, bool rawStored)
+{
+    vector<uint8_t> finalVec;
+
+    // header part <32b-packed-size> to indicate size of chunk data following the header
+    for (unsigned int i = 0; i < sizeof(uint32_t); i++) {
+        finalVec.push_back(packedSize >> (CHAR_BIT * i));
+    }
+    // header part <32b-raw-size> to indicate size of decompressed chunk data
+    for (unsigned int i = 0; i < sizeof(uint32_t); i++) {
+        finalVec.push_back(rawSize >> (CHAR_BIT * i));
+    }
+
+    // header part <8b-flags> [x-------] to indicate whether raw data are stored
+    finalVec.push_back(uint8_t(rawStored) << 7);
+
+    return finalVec;
+}
+
+tuple<uint32_t, uint32_t, bool> extractChunkHeader(const uint8_t *data, uint64_t size)
+{
+    if (size < CHUNK_HEADER_SIZE) {
+        throw CodecError("invalid or missing chunk header", 18);
+    }
+
+    uint32_t packedSize = 0;
+    uint32_t rawSize = 0;
+    for (unsigned int i = sizeof(uint32_t); i > 0; i--) {
+        packedSize = (packedSize << CHAR_BIT) | data[i - 1];
+    }
+    for (unsigned int i = sizeof(uint32_t); i > 0; i--) {
+        rawSize = (rawSize << CHAR_BIT) | data[sizeof(uint32_t) + i - 1];
+    }
+    bool rawStored = (data[2 * sizeof(uint32_t)] >> 7) & 0x01;
+
+    return make_tuple(packedSize, rawSize, rawStored);
+}
+
+vector<uint8_t> createSeekIndex(const vector<uint64_t> &chunkOffsets)
+{
+    vector<uint8_t> finalVec;
+
+    // footer part <64b-chunk-offset> for each chunk
+    for (uint64_t chunkOffset : chunkOffsets)
+    {
+        for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+            finalVec.push_back(chunkOffset >> (CHAR_BIT * i));
+        }
+    }
+    // footer part <64b-chunk-count> at the very end, so the index is found from there
+    for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+        finalVec.push_back(uint64_t(chunkOffsets.size()) >> (CHAR_BIT * i));
+    }
+
+    return finalVec;
+}
+
+vector<uint64_t> extractSeekIndex(const uint8_t *data, uint64_t size)
+{
+    if (size < SEEK_INDEX_ENTRY_SIZE) {
+        throw CodecError("invalid or missing seek index", 27);
+    }
+
+    // read 64-bit value at given index
+    auto readEntry = [data](uint64_t index)
+    {
+        uint64_t value = 0;
+        for (unsigned int i = SEEK_INDEX_ENTRY_SIZE; i > 0; i--) {
+            value = (value << CHAR_BIT) | data[index + i - 1];
+        }
+        return value;
+    };
+
+    uint64_t chunkCount = readEntry(size - SEEK_INDEX_ENTRY_SIZE);
+    if (chunkCount > size / SEEK_INDEX_ENTRY_SIZE - 1) {
+        throw CodecError("invalid or missing seek index", 27);
+    }
+    uint64_t indexStart = size - (chunkCount + 1) * SEEK_INDEX_ENTRY_SIZE;
+    if (indexStart < HUFF_HEADER_SIZE + CHUNK_HEADER_SIZE) { // at least the end chunk
+        throw CodecError("invalid or missing seek index", 27);
+    }
+
+    vector<uint64_t> chunkOffsets(chunkCount);
+    for (uint64_t i = 0; i < chunkCount; i++)
+    {
+        chunkOffsets[i] = readEntry(indexStart + i * SEEK_INDEX_ENTRY_SIZE);
+
+        // chunk headers must precede the index in the order of chunks
+        uint64_t minOffset = i > 0 ? chunkOffsets[i - 1] + CHUNK_HEADER_SIZE : 0;
+        if (chunkOffsets[i] < minOffset || chunkOffsets[i] > indexStart - CHUNK_HEADER_SIZE) {
+            throw CodecError("invalid seek index", 27);
+        }
+    }
+
+    return chunkOffsets;
+}
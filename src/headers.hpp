@@ -10,28 +10,124 @@
 #include <vector>
 #include <cstdint>
 #include <tuple>
-#include <deque>
+
+#include "bitstream.hpp"
+
+#define HUFF_HEADER_SIZE 9 // bytes of Huffman header (without optional parts)
+#define CHUNK_HEADER_SIZE 9 // bytes of chunk header
+#define SEEK_INDEX_ENTRY_SIZE 8 // bytes of one entry of seek index (and its count)
 
 using std::vector;
 using std::tuple;
-using std::deque;
 
 
+// offsets of one row of blocks of tiled adaptive block RLE (from the end of its header)
+struct TileRowOffsets
+{
+    uint64_t dataOffset; // RLE data of the row
+    uint64_t packedOffset; // Huffman coded data of the row (restart point)
+};
+
 // create header for adaptive RLE
 // header parts: <64b-matrix-width><64b-matrix-height><64b-block-size><block-scan-dirs>
+//               [{<varint-row-length>}][{<64b-data-offset><64b-packed-offset>}]
+// lengths of encoded rows of blocks (7 bits per byte, the highest bit marks a next
+// byte) and offsets of rows of blocks (tiled data only) are stored only when given
 vector<uint8_t> createAdaptRLEHeader(
     uint64_t matrixWidth,
     uint64_t matrixHeight,
     uint64_t blockSize,
-    vector<bool> scanDirs);
-// extract adaptive RLE header from given deque of bytes (it removes the header items)
+    vector<bool> scanDirs,
+    const vector<uint64_t> &rowLengths = {},
+    const vector<TileRowOffsets> &rowOffsets = {});
+// extract adaptive RLE header from the beginning of given bytes (with lengths of rows
+// of blocks if stored, and offsets of rows of blocks for tiled data, the first row starts at
+// zero and they never decrease)
 // it returns a tuple of:
 //   * matrix width
 //   * matrix height
 //   * block size
 //   * bit vector of block scan directions
-tuple<uint64_t, uint64_t, uint64_t, vector<bool>> extractAdaptRLEHeader(deque<uint8_t> &deq);
+//   * index of encoded data of each row of blocks (the last item is their total size,
+//     empty when lengths of rows are not stored)
+//   * offsets of rows of blocks (empty for data that are not tiled)
+//   * size of the header (block data follow it)
+tuple<uint64_t, uint64_t, uint64_t, vector<bool>, vector<uint64_t>, vector<TileRowOffsets>, uint64_t>
+extractAdaptRLEHeader(
+    const uint8_t *data,
+    uint64_t size,
+    bool rowLengthsStored = false,
+    bool tilesUsed = false);
+
+// create header for static Huffman coding
+// header parts: <4b-code-length> for each symbol
+vector<uint8_t> createStaticHuffHeader(const uint8_t *codeLengths);
+// extract static Huffman header from given reader
+// it returns code lengths of all symbols
+vector<uint8_t> extractStaticHuffHeader(BitReader &reader);
+
+// create header for 2D predictors
+// header parts: <8b-predictor><64b-matrix-width>[<2b-row-predictor> for each row]
+// row predictors are present only for automatic selection
+vector<uint8_t> createPredHeader(
+    uint8_t predictor,
+    uint64_t matrixWidth,
+    const vector<uint8_t> &rowPredictors);
+// extract header for 2D predictors from the beginning of given bytes, the number of
+// rows is given by the size of decompressed data
+// it returns a tuple of:
+//   * matrix width
+//   * predictor of each row
+//   * size of the header
+tuple<uint64_t, vector<uint8_t>, uint64_t> extractPredHeader(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t rawSize);
+
+// contents of Huffman coding header
+struct HuffHeader
+{
+    uint64_t byteCount = 0; // total number of encoded bytes (chunk size for chunked data)
+    bool diffModelUsed = false;
+    bool adaptRLEUsed = false;
+    bool vitterUsed = false;
+    bool staticUsed = false;
+    bool chunksUsed = false; // data are split to chunks, each one with its own Huffman header
+    bool rawSizeStored = false; // older streams do not contain the raw size
+    uint64_t rawSize = 0; // size of decompressed data (if stored)
+    bool predictorUsed = false; // header for 2D predictors follows (raw size is stored)
+    bool contextsUsed = false; // order-1 context modelling of adaptive Huffman coding
+    bool rescalingUsed = false; // tree frequencies may be halved (long streams only)
+    bool seekIndexStored = false; // seek index follows chunked data (chunks only)
+    bool tilesUsed = false; // rows of blocks of adaptive RLE are coded independently
+    bool rowLengthsStored = false; // adaptive RLE header contains lengths of rows of blocks
+};
 
 // create header for Huffman coding (includes flags for used methods)
-// header parts: <64b-byte-count><8b-flags>
-vector<uint8_t> createHuffHeader(uint64_t byteCount, bool useDiffModel, bool useAdaptRLE);
+// header parts: <64b-byte-count><8b-flags>[<8b-ext-flags>][<64b-raw-size>]
+// extended flags are present only if any of them is set (see the last flag)
+// header for 2D predictors or tiled adaptive RLE may follow it (see their flags)
+vector<uint8_t> createHuffHeader(const HuffHeader &header);
+// extract Huffman header from the beginning of given bytes
+HuffHeader extractHuffHeader(const uint8_t *data, uint64_t size);
+// return the size of Huffman header at the beginning of given bytes (at least
+// its fixed part must be given), the data follow the header
+uint64_t getHuffHeaderSize(const uint8_t *data, uint64_t size);
+
+// create header of one chunk of chunked data
+// header parts: <32b-packed-size><32b-raw-size><8b-flags>
+vector<uint8_t> createChunkHeader(uint32_t packedSize, uint32_t rawSize, bool rawStored);
+// extract chunk header from the beginning of given bytes
+// it returns a tuple of:
+//   * size of packed chunk data (following the header)
+//   * size of raw (decompressed) chunk data
+//   * flag whether raw data are stored instead of compressed ones
+tuple<uint32_t, uint32_t, bool> extractChunkHeader(const uint8_t *data, uint64_t size);
+
+// create seek index of chunked data, it follows the empty chunk at the end
+// footer parts: {<64b-chunk-offset>}<64b-chunk-count>
+// offsets of chunk headers are counted from the beginning of the data
+vector<uint8_t> createSeekIndex(const vector<uint64_t> &chunkOffsets);
+// extract seek index from the end of given chunked data
+// it returns offsets of chunk headers (increasing, each one within the data)
+vector<uint64_t> extractSeekIndex(const uint8_t *data, uint64_t size);
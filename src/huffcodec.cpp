@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of the codec library API (libhuffcodec).
+//------------------------------------------------------------------------------
+
+#include "huffcodec.hpp"
+
+#include <new>
+
+#include "chunks.hpp"
+#include "error.hpp"
+
+using std::bad_alloc;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// check options for compression (the CLI checks them the same way)
+void checkComprOptions(const CodecOptions &options)
+{
+    if (options.matrixWidth == 0) {
+        throw CodecError("invalid 2D data width", 4);
+    }
+    if (options.chunkSize > MAX_CHUNK_SIZE) {
+        throw CodecError("invalid chunk size", 4);
+    }
+    if (options.useDiffModel && options.predictor != PRED_NONE) {
+        throw CodecError("differential model cannot be used with 2D predictor", 4);
+    }
+    if (options.useStatic && options.useContexts) {
+        throw CodecError("contexts cannot be used with static Huffman coding", 4);
+    }
+    if (options.useTiles && !options.useAdaptRLE) {
+        throw CodecError("tiles can be used only with adaptive block RLE", 4);
+    }
+    if (options.useTiles && (options.useDiffModel || options.predictor != PRED_NONE)) {
+        throw CodecError("tiles cannot be used with differential model or 2D predictor", 4);
+    }
+    if (options.useTiles && (options.chunkSize != 0 || options.useSeekIndex)) {
+        throw CodecError("tiles cannot be used with chunks", 4);
+    }
+}
+
+// check options for decompression (the CLI checks them the same way)
+void checkDecomprOptions(const CodecOptions &options)
+{
+    if (options.usesRect() && (options.rectWidth == 0 || options.rectHeight == 0)) {
+        throw CodecError("invalid rectangle of 2D data", 4);
+    }
+    if (options.usesRange() && options.usesRect()) {
+        throw CodecError("range cannot be used with rectangle", 4);
+    }
+}
+
+// return options for compression, seek index needs chunks, so they are always
+// used with it (of the same size as for piped input, unless configured)
+CodecOptions getComprOptions(const CodecOptions &options)
+{
+    CodecOptions comprOptions = options;
+    if (options.useSeekIndex && options.chunkSize == 0) {
+        comprOptions.chunkSize = DEFAULT_STREAM_CHUNK_SIZE;
+    }
+    return comprOptions;
+}
+
+// -------------------------- PUBLIC -------------------------------------------
+
+HuffCodec::HuffCodec(unsigned int threadCount) : threadPool(threadCount) {}
+
+HuffResult HuffCodec::compress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    vector<uint8_t> &outData)
+{
+    return run([&]()
+    {
+        checkComprOptions(options);
+        huffCompress(data, size, getComprOptions(options), threadPool, buffers, outData);
+        return outData.size();
+    });
+}
+
+HuffResult HuffCodec::decompress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    vector<uint8_t> &outData)
+{
+    return run([&]()
+    {
+        checkDecomprOptions(options);
+        return huffDecompress(data, size, options, threadPool, buffers,
+            [&outData](uint64_t rawSize)
+            {
+                outData.resize(rawSize);
+                return outData.data();
+            });
+    });
+}
+
+HuffResult HuffCodec::decompress(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    const OutputAllocator &allocOutput)
+{
+    return run([&]()
+    {
+        checkDecomprOptions(options);
+        return huffDecompress(data, size, options, threadPool, buffers, allocOutput);
+    });
+}
+
+HuffResult HuffCodec::compress(istream &is, ostream &os, const CodecOptions &options)
+{
+    return run([&]()
+    {
+        checkComprOptions(options);
+        return huffCompressStream(is, os, getComprOptions(options), threadPool, buffers);
+    });
+}
+
+HuffResult HuffCodec::decompress(istream &is, ostream &os, const CodecOptions &options)
+{
+    return run([&]()
+    {
+        checkDecomprOptions(options);
+        return huffDecompressStream(is, os, options, threadPool, buffers);
+    });
+}
+
+// -------------------------- PRIVATE ------------------------------------------
+
+HuffResult HuffCodec::run(const function<uint64_t()> &operation)
+{
+    HuffResult result;
+    try {
+        result.size = operation();
+    }
+    catch (const CodecError &error)
+    {
+        result.code = error.getCode();
+        result.message = error.what();
+    }
+    catch (const bad_alloc &)
+    {
+        result.code = 26;
+        result.message = "not enough memory";
+    }
+
+    return result;
+}
@@ -0,0 +1,81 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of the codec library API (libhuffcodec).
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <functional>
+
+#include "codec.hpp"
+#include "threadpool.hpp"
+
+using std::string;
+using std::vector;
+using std::istream;
+using std::ostream;
+using std::function;
+
+
+// result of one call of the codec
+struct HuffResult
+{
+    int code = 0; // zero on success, otherwise the same as exit code of the CLI
+    string message; // description of the error (empty on success)
+    uint64_t size = 0; // number of output bytes
+
+    // return whether the call succeeded
+    bool isOk() const {
+        return code == 0;
+    }
+};
+
+// reusable context of the codec, it may be used for any number of calls (one at
+// a time), its threads and scratch buffers of single streams are kept across the
+// calls, and output vectors given by the caller are reused (their capacity is kept)
+// no call ever exits the process, errors are returned in results instead
+class HuffCodec
+{
+public:
+    // create context with given number of threads (zero means all cores)
+    HuffCodec(unsigned int threadCount = 0);
+
+    // compress given buffer to given vector (its contents are replaced)
+    HuffResult compress(
+        const uint8_t *data,
+        uint64_t size,
+        const CodecOptions &options,
+        vector<uint8_t> &outData);
+    // decompress given buffer to given vector (its contents are replaced)
+    HuffResult decompress(
+        const uint8_t *data,
+        uint64_t size,
+        const CodecOptions &options,
+        vector<uint8_t> &outData);
+    // decompress given buffer straight to the target from given allocator
+    // (the allocator may report its own errors by throwing CodecError)
+    HuffResult decompress(
+        const uint8_t *data,
+        uint64_t size,
+        const CodecOptions &options,
+        const OutputAllocator &allocOutput);
+
+    // compress data from given input stream to given output stream
+    HuffResult compress(istream &is, ostream &os, const CodecOptions &options);
+    // decompress data from given input stream to given output stream
+    HuffResult decompress(istream &is, ostream &os, const CodecOptions &options);
+
+private:
+    ThreadPool threadPool;
+    CodecBuffers buffers; // scratch buffers of single streams
+
+    // run given operation returning its output size, errors are turned to results
+    HuffResult run(const function<uint64_t()> &operation);
+};
@@ -2,265 +2,571 @@
 // Copyright 2022 Dominik Salvet
 // https://github.com/dominiksalvet/huffman-codec
 //------------------------------------------------------------------------------
-// The implementation of Huffman FGK tree and helper functions.
+// The implementation of adaptive Huffman trees (FGK) and helper functions.
 //------------------------------------------------------------------------------
 
 #include "huffman.hpp"
 
 #include <algorithm>
+#include <utility>
 
-using std::reverse;
+using std::max;
+using std::fill;
+using std::sort;
+using std::pair;
 
 
-bool isLeaf(const HuffNode *node)
+bool isLeaf(const HuffNode &node)
 {
     // no need to check the other child for Huffman FGK tree
-    return node->left == nullptr;
+    return node.left == NULL_NODE;
 }
 
 // -------------------------- PUBLIC -------------------------------------------
 
-HuffTree::HuffTree()
+AdaptHuffTree::AdaptHuffTree()
 {
+    fill(symbolNodes, symbolNodes + MAX_SYMBOLS, NULL_NODE);
+    fill(numberedNodes, numberedNodes + MAX_NODES, NULL_NODE);
+
     // NYT is not included in the symbols alphabet (hence this formula)
     uint16_t firstNodeNum = 2 * MAX_SYMBOLS; // also, include 0 as node number
 
     // create tree with NYT node only
-    root = new HuffNode{firstNodeNum, 0, 0, nullptr, nullptr, nullptr};
+    nodeCount = 0;
+    root = allocNode(firstNodeNum, NULL_NODE, 0);
     nodeNYT = root;
-}
 
-HuffTree::~HuffTree() {
-    deleteNode(root);
+    useDecodeTable = true;
+    useRawEscapes = true;
+    useRescaling = true;
+
+    useCodeCache = false;
+    codeCacheHits = 0;
+    codeCacheLookups = 0;
+
+    swapCount = 0;
+    escapeCount = 0;
 }
 
-vector<bool> HuffTree::encode(uint8_t symbol)
+void AdaptHuffTree::encode(uint8_t symbol, BitWriter &writer)
 {
-    vector<bool> code;
-    HuffNode *symbolNode = symbolNodes[symbol];
+    uint16_t symbolNode = symbolNodes[symbol];
+    uint16_t codeNode = symbolNode;
+    uint16_t codeIndex = symbol;
 
-    if (symbolNode == nullptr) // no symbol existing => not yet transmitted
+    if (symbolNode == NULL_NODE) // no symbol existing => not yet transmitted
     {
-        code = nodeToCode(nodeNYT); // we must start with NYT code
+        codeNode = nodeNYT; // we must start with NYT code
+        codeIndex = NYT_CODE_INDEX;
+    }
 
-        // current symbol to boolean vector conversion
-        for (int i = BITS_IN_SYMBOL; i > 0; i--)
-        {
-            bool curBit = (symbol >> (i - 1)) & 0x01;
-            code.push_back(curBit);
-        }
+    useCodeCache = true; // start maintaining the cache
+    codeCacheLookups++;
+
+    HuffCode &code = codeCache[codeIndex];
+    if (code.valid) {
+        codeCacheHits++;
     }
-    else {
-        code = nodeToCode(symbolNode);
+    else
+    {
+        code.bits = 0;
+        code.length = 0;
+        code.valid = collectNodeCode(codeNode, code) == root;
     }
 
-    return code;
+    if (code.valid) {
+        writer.write(code.bits, code.length);
+    } else {
+        writeNodeCode(codeNode, writer); // too long code for the cache
+    }
+
+    if (symbolNode == NULL_NODE && useRawEscapes) {
+        writer.write(symbol, BITS_IN_SYMBOL); // then the symbol itself
+    }
 }
 
-int HuffTree::decode(deque<bool> *const code)
+int AdaptHuffTree::decode(BitReader &reader)
 {
-    HuffNode *curNode = root;
-    while (!isLeaf(curNode))
+    uint16_t curNode = root;
+
+    // resolve the beginning of the code at once (if enough bits remaining)
+    if (useDecodeTable && reader.getRemainBitCount() >= DECODE_TABLE_BITS)
+    {
+        if (decodeTable.empty()) // build the table on demand
+        {
+            decodeTable.resize(uint64_t(1) << DECODE_TABLE_BITS);
+            fillDecodeTable(root, 0, 0);
+        }
+
+        const HuffDecodeEntry &entry = decodeTable[reader.peek(DECODE_TABLE_BITS)];
+        reader.skip(entry.bitCount);
+        curNode = entry.node;
+    }
+
+    // continue bit by bit (for long codes, or at the end of data)
+    while (!isLeaf(nodes[curNode]))
     {
-        if (code->empty()) {
+        if (reader.isEmpty()) {
             return -1;
         }
 
         // decision bit to choose the next node
-        bool decBit = code->front(); code->pop_front();
-        curNode = decBit ? curNode->right : curNode->left;
+        bool decBit = reader.readBit();
+        curNode = decBit ? nodes[curNode].right : nodes[curNode].left;
     }
 
     uint8_t finalSymbol;
     if (curNode == nodeNYT)
     {
-        finalSymbol = 0;
-        for (int i = 0; i < BITS_IN_SYMBOL; i++)
-        {
-            if (code->empty()) {
-                return -1;
-            }
-
-            bool curBit = code->front(); code->pop_front();
-            finalSymbol = (finalSymbol << 1) | curBit;
+        if (!useRawEscapes) {
+            return NYT_SYMBOL;
+        }
+        if (reader.getRemainBitCount() < BITS_IN_SYMBOL) {
+            return -1;
         }
+        finalSymbol = reader.read(BITS_IN_SYMBOL);
     }
     else {
-        finalSymbol = curNode->symbol;
+        finalSymbol = nodes[curNode].symbol;
     }
 
     return finalSymbol;
 }
 
-void HuffTree::update(uint8_t symbol)
+void AdaptHuffTree::setDecodeTable(bool enabled)
 {
-    HuffNode *node = symbolNodes[symbol];
+    useDecodeTable = enabled;
+    if (!enabled) {
+        decodeTable.clear(); // no need to keep it updated
+    }
+}
 
-    if (node == nullptr) // NYT node splitting (add new symbol)
-    {
-        HuffNode *leftChild = new HuffNode{
-            uint16_t(nodeNYT->nodeNum - 2), 0, 0, nodeNYT, nullptr, nullptr};
-        node = new HuffNode{
-            uint16_t(nodeNYT->nodeNum - 1), 0, symbol, nodeNYT, nullptr, nullptr};
-        
-        nodeNYT->left = leftChild; // new NYT node
-        nodeNYT->right = node; // new node for symbol
+void AdaptHuffTree::setRawEscapes(bool enabled) {
+    useRawEscapes = enabled;
+}
 
-        nodeNYT = leftChild;
-        symbolNodes[symbol] = node; // register new symbol
-    }
+bool AdaptHuffTree::hasSymbol(uint8_t symbol) const {
+    return symbolNodes[symbol] != NULL_NODE;
+}
 
-    while (node != root)
-    {
-        HuffNode *succNode = findSuccNode(root, node->freq);
+void AdaptHuffTree::setRescaling(bool enabled) {
+    useRescaling = enabled;
+}
 
-        // check if any valid successor found (also useless to switch same nodes)
-        if (succNode != nullptr &&
-            succNode != node->parent &&
-            succNode != node) {
-            swapNodes(node, succNode);
-        }
-        node->freq++;
+uint64_t AdaptHuffTree::getCodeCacheHits() const {
+    return codeCacheHits;
+}
 
-        node = node->parent; // next node
-    }
-    node->freq++; // also increase root freq afterwards
+uint64_t AdaptHuffTree::getCodeCacheLookups() const {
+    return codeCacheLookups;
 }
 
-void HuffTree::print(ostream &os) {
+uint64_t AdaptHuffTree::getSwapCount() const {
+    return swapCount;
+}
+
+uint64_t AdaptHuffTree::getEscapeCount() const {
+    return escapeCount;
+}
+
+unsigned int AdaptHuffTree::getMaxDepth() const {
+    return getNodeDepth(root);
+}
+
+void AdaptHuffTree::print(ostream &os) {
     printNode(root, os);
 }
 
-// -------------------------- PRIVATE ------------------------------------------
+// -------------------------- PROTECTED ----------------------------------------
 
-vector<bool> HuffTree::nodeToCode(HuffNode *const node)
+uint16_t AdaptHuffTree::splitNYT(uint8_t symbol)
 {
-    vector<bool> code;
+    uint16_t formerNYT = nodeNYT;
+    uint16_t nodeNum = nodes[formerNYT].nodeNum;
+    uint16_t leftChild = allocNode(nodeNum - 2, formerNYT, 0);
+    uint16_t node = allocNode(nodeNum - 1, formerNYT, symbol);
+
+    nodes[formerNYT].left = leftChild; // new NYT node
+    nodes[formerNYT].right = node; // new node for symbol
+
+    nodeNYT = leftChild;
+    symbolNodes[symbol] = node; // register new symbol
+    escapeCount++;
+
+    // former NYT node is not a leaf anymore
+    updateDecodeTable(formerNYT);
+    if (useCodeCache) {
+        invalidateCodeCache(formerNYT);
+    }
+
+    return node;
+}
+
+void AdaptHuffTree::swapNodes(uint16_t node1, uint16_t node2)
+{
+    swapCount++;
+    HuffNode &first = nodes[node1];
+    HuffNode &second = nodes[node2];
+
+    // swap nodes number (since that does not change when swapping nodes)
+    uint16_t node1Num = first.nodeNum;
+    first.nodeNum = second.nodeNum;
+    second.nodeNum = node1Num;
+    numberedNodes[first.nodeNum] = node1;
+    numberedNodes[second.nodeNum] = node2;
+
+    // first scan, then modify (to prevent bugs)
+    bool node1IsLeftChild = nodes[first.parent].left == node1;
+    bool node2IsLeftChild = nodes[second.parent].left == node2;
+
+    if (node1IsLeftChild) {
+        nodes[first.parent].left = node2;
+    } else {
+        nodes[first.parent].right = node2;
+    }
+    if (node2IsLeftChild) {
+        nodes[second.parent].left = node1;
+    } else {
+        nodes[second.parent].right = node1;
+    }
+
+    uint16_t node1Parent = first.parent;
+    first.parent = second.parent;
+    second.parent = node1Parent;
 
-    HuffNode *curNode = node;
-    while(curNode != root) // up to the root
+    updateDecodeTable(node1);
+    updateDecodeTable(node2);
+    if (useCodeCache)
     {
-        // add bits incrementally
-        if (curNode->parent->left == curNode) {
-            code.push_back(0);
-        } else {
-            code.push_back(1);
-        }
-        curNode = curNode->parent;
+        invalidateCodeCache(node1);
+        invalidateCodeCache(node2);
     }
+}
 
-    // the received code is in the reverse order
-    reverse(code.begin(), code.end());
-    return code;
+bool AdaptHuffTree::needsRescaling() const {
+    return useRescaling && nodes[root].freq >= MAX_ROOT_FREQ;
 }
 
-HuffNode* HuffTree::findSuccNode(HuffNode *const node, uint64_t freq)
+void AdaptHuffTree::rescale(bool leavesFirst)
 {
-    HuffNode *succNode = nullptr;
+    // leaves with halved frequencies (symbols keep at least one), sorted by them
+    // NYT has zero frequency, so it stays the first one (with the lowest number)
+    pair<uint32_t, uint16_t> leaves[MAX_SYMBOLS + 1];
+    uint16_t leafCount = 0;
+    for (uint16_t i = 0; i < nodeCount; i++)
+    {
+        if (i == nodeNYT) {
+            leaves[leafCount++] = {0, NYT_SYMBOL};
+        } else if (isLeaf(nodes[i])) {
+            leaves[leafCount++] = {(nodes[i].freq + 1) / 2, nodes[i].symbol};
+        }
+    }
+    sort(leaves, leaves + leafCount);
 
-    if (!isLeaf(node) && node->freq > freq) // still higher value
+    fill(symbolNodes, symbolNodes + MAX_SYMBOLS, NULL_NODE);
+    fill(numberedNodes, numberedNodes + MAX_NODES, NULL_NODE);
+    nodeCount = 0;
+    for (uint16_t i = 0; i < leafCount; i++)
     {
-        HuffNode *leftSuccNode = findSuccNode(node->left, freq);
-        HuffNode *rightSuccNode = findSuccNode(node->right, freq);
+        uint16_t symbol = leaves[i].second;
+        uint16_t node = nodeCount++;
+        nodes[node] = {leaves[i].first, 0, NULL_NODE, NULL_NODE, NULL_NODE, 0, uint8_t(symbol)};
 
-        if (leftSuccNode != nullptr && rightSuccNode != nullptr)
-        {
-            // prefer higher node number if both subtrees have candidate
-            if (leftSuccNode->nodeNum > rightSuccNode->nodeNum) {
-                succNode = leftSuccNode;
-            } else {
-                succNode = rightSuccNode;
-            }
+        if (symbol == NYT_SYMBOL) {
+            nodeNYT = node;
+        } else {
+            symbolNodes[symbol] = node;
         }
-        else { // otherwise set to valid pointer of those two if exists
-            succNode = leftSuccNode != nullptr ? leftSuccNode : rightSuccNode;
+    }
+
+    // merge two nodes with the lowest frequencies, internal nodes are created with
+    // nondecreasing frequencies, so both leaves and internal nodes are queues in
+    // the pool, and they are numbered in merge order
+    uint16_t nextLeaf = 0;
+    uint16_t nextInternal = leafCount;
+    uint16_t nodeNum = 2 * MAX_SYMBOLS - 2 * (leafCount - 1);
+    while (nodeCount - nextInternal + leafCount - nextLeaf > 1)
+    {
+        uint16_t children[2];
+        for (uint16_t &child : children)
+        {
+            bool takeLeaf = nextLeaf < leafCount && (nextInternal == nodeCount ||
+                nodes[nextLeaf].freq < nodes[nextInternal].freq ||
+                (leavesFirst && nodes[nextLeaf].freq == nodes[nextInternal].freq));
+            child = takeLeaf ? nextLeaf++ : nextInternal++;
+            nodes[child].nodeNum = nodeNum;
+            numberedNodes[nodeNum++] = child;
         }
+
+        uint16_t parent = nodeCount++;
+        nodes[parent] = {nodes[children[0]].freq + nodes[children[1]].freq, 0,
+                         NULL_NODE, children[0], children[1], 0, 0};
+        nodes[children[0]].parent = parent;
+        nodes[children[1]].parent = parent;
+    }
+    root = nodeCount - 1;
+    nodes[root].nodeNum = nodeNum;
+    numberedNodes[nodeNum] = root;
+
+    // all codes have changed
+    if (!decodeTable.empty()) {
+        fillDecodeTable(root, 0, 0);
     }
-    else if (node->freq == freq) {
-        succNode = node;
+    for (HuffCode &code : codeCache) {
+        code.valid = false;
     }
+}
 
-    return succNode;
+// -------------------------- PRIVATE ------------------------------------------
+
+uint16_t AdaptHuffTree::allocNode(uint16_t nodeNum, uint16_t parent, uint8_t symbol)
+{
+    uint16_t node = nodeCount++;
+    nodes[node] = {0, nodeNum, parent, NULL_NODE, NULL_NODE, 0, symbol};
+    numberedNodes[nodeNum] = node;
+    return node;
 }
 
-void HuffTree::swapNodes(HuffNode *const node1, HuffNode *const node2)
+void AdaptHuffTree::writeNodeCode(uint16_t node, BitWriter &writer)
 {
-    // swap nodes number (since that does not change when swapping nodes)
-    uint16_t node1Num = node1->nodeNum;
-    node1->nodeNum = node2->nodeNum;
-    node2->nodeNum = node1Num;
+    HuffCode code = {0, 0, false};
+    uint16_t upperNode = collectNodeCode(node, code);
 
-    // first scan, then modify (to prevent bugs)
-    bool node1IsLeftChild = false;
-    if (node1->parent->left == node1) {
-        node1IsLeftChild = true;
+    // code longer than the whole word (very deep tree), write its beginning first
+    if (upperNode != root) {
+        writeNodeCode(upperNode, writer);
     }
-    bool node2IsLeftChild = false;
-    if (node2->parent->left == node2) {
-        node2IsLeftChild = true;
+    writer.write(code.bits, code.length);
+}
+
+uint16_t AdaptHuffTree::collectNodeCode(uint16_t node, HuffCode &code)
+{
+    // add bits incrementally, the received code is in the reverse order, so the
+    // first received bit is the lowest one
+    while (node != root && code.length < BITS_IN_WORD)
+    {
+        uint16_t parent = nodes[node].parent;
+        if (nodes[parent].right == node) {
+            code.bits |= uint64_t(1) << code.length;
+        }
+        code.length++;
+        node = parent;
     }
 
-    if (node1IsLeftChild) {
-        node1->parent->left = node2;
-    } else {
-        node1->parent->right = node2;
+    return node;
+}
+
+void AdaptHuffTree::invalidateCodeCache(uint16_t node)
+{
+    if (isLeaf(nodes[node]))
+    {
+        uint16_t codeIndex = node == nodeNYT ? NYT_CODE_INDEX : nodes[node].symbol;
+        codeCache[codeIndex].valid = false;
+        return;
     }
-    if (node2IsLeftChild) {
-        node2->parent->left = node1;
-    } else {
-        node2->parent->right = node1;
+
+    invalidateCodeCache(nodes[node].left);
+    invalidateCodeCache(nodes[node].right);
+}
+
+void AdaptHuffTree::updateDecodeTable(uint16_t node)
+{
+    if (decodeTable.empty()) { // no table built yet (e.g., when encoding)
+        return;
     }
 
-    HuffNode *node1Parent = node1->parent;
-    node1->parent = node2->parent;
-    node2->parent = node1Parent;
+    // find code prefix of the node (only nodes up to the table depth are present)
+    uint64_t prefix = 0;
+    unsigned int depth = 0;
+    for (uint16_t curNode = node; curNode != root; curNode = nodes[curNode].parent)
+    {
+        if (depth == DECODE_TABLE_BITS) {
+            return;
+        }
+        prefix |= uint64_t(nodes[nodes[curNode].parent].right == curNode) << depth;
+        depth++;
+    }
+
+    fillDecodeTable(node, prefix, depth);
+}
+
+void AdaptHuffTree::fillDecodeTable(uint16_t node, uint64_t prefix, unsigned int depth)
+{
+    if (isLeaf(nodes[node]) || depth == DECODE_TABLE_BITS)
+    {
+        // all entries starting with the prefix end in this node
+        uint64_t firstIndex = prefix << (DECODE_TABLE_BITS - depth);
+        uint64_t entryCount = uint64_t(1) << (DECODE_TABLE_BITS - depth);
+        for (uint64_t i = firstIndex; i < firstIndex + entryCount; i++) {
+            decodeTable[i] = {node, uint8_t(depth)};
+        }
+        return;
+    }
+
+    fillDecodeTable(nodes[node].left, prefix << 1, depth + 1);
+    fillDecodeTable(nodes[node].right, (prefix << 1) | 1, depth + 1);
 }
 
 // -------------------------- HELPER FUNCTIONS ---------------------------------
 
-void HuffTree::deleteNode(const HuffNode *node)
+unsigned int AdaptHuffTree::getNodeDepth(uint16_t node) const
 {
-    if (node != nullptr)
-    {
-        deleteNode(node->left);
-        deleteNode(node->right);
-        delete node;
+    if (isLeaf(nodes[node])) {
+        return 0;
     }
+    return 1 + max(getNodeDepth(nodes[node].left), getNodeDepth(nodes[node].right));
 }
 
-void HuffTree::printNode(const HuffNode *node, ostream &os)
+void AdaptHuffTree::printNode(uint16_t node, ostream &os)
 {
-    os << "nodeNum: " << node->nodeNum << 
-          ", freq: " << node->freq <<
-          ", symbol: " << node->symbol;
-    
+    const HuffNode &curNode = nodes[node];
+    os << "nodeNum: " << curNode.nodeNum <<
+          ", freq: " << curNode.freq <<
+          ", symbol: " << curNode.symbol;
+
     os << ", parent: ";
-    if (node->parent != nullptr) {
-        os << node->parent->nodeNum;
+    if (curNode.parent != NULL_NODE) {
+        os << nodes[curNode.parent].nodeNum;
     } else {
         os << "NULL";
     }
 
     os << ", left: ";
-    if (node->left != nullptr) {
-        os << node->left->nodeNum;
+    if (curNode.left != NULL_NODE) {
+        os << nodes[curNode.left].nodeNum;
     } else {
         os << "NULL";
     }
 
     os << ", right: ";
-    if (node->right != nullptr) {
-        os << node->right->nodeNum;
+    if (curNode.right != NULL_NODE) {
+        os << nodes[curNode.right].nodeNum;
     } else {
         os << "NULL";
     }
     os << "\n";
 
-    if (node->left != nullptr) {
-        printNode(node->left, os);
+    if (curNode.left != NULL_NODE) {
+        printNode(curNode.left, os);
+    }
+
+    if (curNode.right != NULL_NODE) {
+        printNode(curNode.right, os);
+    }
+}
+
+// -------------------------- FGK ----------------------------------------------
+
+HuffTree::HuffTree()
+{
+    // all blocks are unused at the beginning
+    for (freeBlockCount = 0; freeBlockCount < MAX_NODES; freeBlockCount++) {
+        freeBlocks[freeBlockCount] = freeBlockCount;
+    }
+    nodes[root].block = allocBlock(root);
+}
+
+void HuffTree::update(uint8_t symbol)
+{
+    uint16_t node = symbolNodes[symbol];
+
+    if (node == NULL_NODE) // NYT node splitting (add new symbol)
+    {
+        node = splitNYT(symbol);
+        // both new nodes have zero frequency, so they join the block of former NYT node
+        uint16_t block = nodes[nodes[node].parent].block;
+        nodes[node].block = block;
+        nodes[nodeNYT].block = block;
     }
 
-    if (node->right != nullptr) {
-        printNode(node->right, os);
+    while (node != NULL_NODE) // up to the root (including)
+    {
+        // successor is the node with the greatest node number and the same frequency
+        uint16_t succNode = blocks[nodes[node].block].leader;
+
+        if (succNode == nodes[node].parent)
+        {
+            // sibling is NYT node (zero frequency), so parent must leave the block first
+            // and the node becomes the leader afterwards (no swapping in this case)
+            incrementNode(succNode);
+            incrementNode(node);
+            node = nodes[succNode].parent; // next node
+        }
+        else
+        {
+            if (succNode != node) // useless to switch same nodes
+            {
+                swapNodes(node, succNode);
+                blocks[nodes[node].block].leader = node;
+            }
+            incrementNode(node);
+            node = nodes[node].parent; // next node
+        }
+    }
+
+    if (needsRescaling())
+    {
+        rescale(false);
+        rebuildBlocks();
     }
 }
+
+void HuffTree::incrementNode(uint16_t node)
+{
+    HuffNode &curNode = nodes[node];
+
+    // leave the current block, so the node with one lower number becomes the leader
+    uint16_t block = curNode.block;
+    uint16_t lowerNode = curNode.nodeNum > 0 ? numberedNodes[curNode.nodeNum - 1] : NULL_NODE;
+    if (lowerNode != NULL_NODE && nodes[lowerNode].block == block) {
+        blocks[block].leader = lowerNode;
+    } else {
+        freeBlock(block); // it was the last node of the block
+    }
+
+    curNode.freq++;
+
+    // join the block right above it (if the same frequency), or create a new one
+    uint16_t upperNode = curNode.nodeNum + 1 < MAX_NODES ?
+        numberedNodes[curNode.nodeNum + 1] : NULL_NODE;
+    if (upperNode != NULL_NODE && nodes[upperNode].freq == curNode.freq) {
+        curNode.block = nodes[upperNode].block;
+    } else {
+        curNode.block = allocBlock(node);
+    }
+}
+
+void HuffTree::rebuildBlocks()
+{
+    for (freeBlockCount = 0; freeBlockCount < MAX_NODES; freeBlockCount++) {
+        freeBlocks[freeBlockCount] = freeBlockCount;
+    }
+
+    // nodes of the same frequency have contiguous numbers, the last one leads them
+    uint16_t lowerNode = NULL_NODE;
+    for (uint16_t nodeNum = nodes[nodeNYT].nodeNum; nodeNum < MAX_NODES; nodeNum++)
+    {
+        uint16_t node = numberedNodes[nodeNum];
+        if (lowerNode != NULL_NODE && nodes[lowerNode].freq == nodes[node].freq)
+        {
+            nodes[node].block = nodes[lowerNode].block;
+            blocks[nodes[node].block].leader = node;
+        }
+        else {
+            nodes[node].block = allocBlock(node);
+        }
+        lowerNode = node;
+    }
+}
+
+uint16_t HuffTree::allocBlock(uint16_t leader)
+{
+    uint16_t block = freeBlocks[--freeBlockCount];
+    blocks[block].leader = leader;
+    return block;
+}
+
+void HuffTree::freeBlock(uint16_t block) {
+    freeBlocks[freeBlockCount++] = block;
+}
@@ -2,78 +2,206 @@
 // Copyright 2022 Dominik Salvet
 // https://github.com/dominiksalvet/huffman-codec
 //------------------------------------------------------------------------------
-// Header file for Huffman FGK tree and helper functions.
+// Header file for adaptive Huffman trees (FGK) and helper functions.
 //------------------------------------------------------------------------------
 
 #pragma once
 
 #include <cstdint>
 #include <ostream>
-#include <deque>
 #include <vector>
 
-using std::deque;
+#include "bitstream.hpp"
+
 using std::ostream;
 using std::vector;
 
 #define MAX_SYMBOLS 256 // max possible symbols
 #define BITS_IN_SYMBOL 8 // number of bits in one symbol
+#define MAX_NODES (2 * MAX_SYMBOLS + 1) // symbols, internal nodes and NYT
+#define DECODE_TABLE_BITS 10 // number of bits resolved by one decode table lookup
+#define NYT_CODE_INDEX MAX_SYMBOLS // NYT code is cached after all symbols
+#define NYT_SYMBOL MAX_SYMBOLS // decoded NYT without following symbol (no raw escapes)
+
+
+#define NULL_NODE UINT16_MAX // index of missing node (nodes are in a fixed pool)
+#define MAX_ROOT_FREQ (uint32_t(1) << 24) // frequencies are halved when reached
 
 
+// nodes are referenced by 16-bit indices to the pool of their tree, so a node
+// takes 16 bytes and the whole tree is in a few kilobytes of contiguous memory
 struct HuffNode
 {
+    uint32_t freq; // frequencies are halved before their overflow
     uint16_t nodeNum;
-    uint64_t freq; // range is big enough for any real data
+
+    uint16_t parent;
+    uint16_t left, right;
+
+    uint16_t block; // block of all nodes with the same frequency (FGK only)
     uint8_t symbol; // for leaf nodes only
+};
+
+// nodes with the same frequency have contiguous node numbers (sibling property)
+// so the whole block is described by its node with the highest node number
+struct HuffBlock
+{
+    uint16_t leader;
+};
 
-    HuffNode *parent;
-    HuffNode *left, *right;
+// result of walking the tree from the root by given code prefix
+struct HuffDecodeEntry
+{
+    uint16_t node; // leaf or node at the maximum depth of the table
+    uint8_t bitCount; // number of bits used to get to the node
+};
+
+// code of a node packed in a word (the last bit of the code is the lowest one)
+struct HuffCode
+{
+    uint64_t bits;
+    uint8_t length;
+    bool valid; // false when the tree changed (or the code is too long to be cached)
 };
 
 // check if the given node is a leaf node
-bool isLeaf(const HuffNode *node);
+bool isLeaf(const HuffNode &node);
 
 
 // symbol is something to be encoded
 // code is something to be decoded
 
-class HuffTree
+// common base of adaptive Huffman trees (they differ only in the way of update)
+class AdaptHuffTree
 {
 public:
-    // initialize the Huffman FGK tree
-    HuffTree();
-    // clean-up the tree
-    ~HuffTree();
+    // initialize the tree with NYT node only
+    AdaptHuffTree();
 
-    // encode given symbol based on current tree
-    vector<bool> encode(uint8_t symbol);
+    // encode given symbol based on current tree and write its code
+    void encode(uint8_t symbol, BitWriter &writer);
     // decode and extract one symbol from given code
     // return -1 when unexpected end of input stream from the code
-    int decode(deque<bool> *const code);
-
-    // update the tree based on given symbol
-    void update(uint8_t symbol);
+    int decode(BitReader &reader);
+    // enable or disable decoding multiple bits at once using lookup table
+    // it is enabled by default, the decoded symbols are the same in both cases
+    void setDecodeTable(bool enabled);
+    // enable or disable raw symbols following NYT code (enabled by default)
+    // when disabled, new symbols must be coded by other means (e.g., another tree)
+    // and NYT_SYMBOL is decoded instead of them
+    void setRawEscapes(bool enabled);
+    // check if given symbol is already present in the tree
+    bool hasSymbol(uint8_t symbol) const;
+    // enable or disable halving of frequencies when the root reaches MAX_ROOT_FREQ
+    // (enabled by default), the tree is rebuilt from halved frequencies then
+    void setRescaling(bool enabled);
+
+    // return the number of encoded symbols, whose code was found in the code cache
+    uint64_t getCodeCacheHits() const;
+    // return the number of all code cache lookups (equal to encoded symbols)
+    uint64_t getCodeCacheLookups() const;
+    // return the number of node swaps performed by tree updates
+    uint64_t getSwapCount() const;
+    // return the number of NYT escapes (symbols added to the tree)
+    uint64_t getEscapeCount() const;
+    // return the maximum depth of the tree (the longest code length)
+    unsigned int getMaxDepth() const;
 
     // print internal representation of tree to given stream (for debugging)
     void print(ostream &os);
 
-private:
-    // pointers to root and NYT node
-    HuffNode *root;
-    HuffNode *nodeNYT;
-
-    // pointers to symbol nodes
-    HuffNode *symbolNodes[MAX_SYMBOLS] = {}; // initialized with nullptrs
-    
-    // go through the tree up to the root to provide the code of the node symbol
-    vector<bool> nodeToCode(HuffNode *const node);
-    // recursively search given node for greatest node number with the given frequency
-    HuffNode* findSuccNode(HuffNode *const node, uint64_t freq);
+protected:
+    // pool of nodes (they are never freed, unless the whole tree is rebuilt)
+    HuffNode nodes[MAX_NODES];
+    uint16_t nodeCount;
+
+    // indices of root and NYT node
+    uint16_t root;
+    uint16_t nodeNYT;
+
+    // indices of symbol nodes
+    uint16_t symbolNodes[MAX_SYMBOLS];
+    // indices of nodes indexed by their node numbers
+    uint16_t numberedNodes[MAX_NODES];
+
+    // lookup table for decoding, indexed by the following code bits
+    // it is built with the first decoding and patched when the tree shape changes
+    vector<HuffDecodeEntry> decodeTable;
+    bool useDecodeTable;
+
+    bool useRawEscapes;
+    bool useRescaling;
+
+    // cached codes of symbols (and NYT), maintained only after the first encoding
+    // codes of leaves in subtrees moved by the tree changes are invalidated
+    HuffCode codeCache[MAX_SYMBOLS + 1] = {};
+    bool useCodeCache;
+    uint64_t codeCacheHits;
+    uint64_t codeCacheLookups;
+
+    // counters of tree changes (for statistics)
+    uint64_t swapCount;
+    uint64_t escapeCount;
+
+    // split NYT node to new NYT node and node of given symbol (returns the symbol node)
+    uint16_t splitNYT(uint8_t symbol);
     // swap two given nodes (must not be called on the root node)
-    void swapNodes(HuffNode *const node1, HuffNode *const node2);
+    void swapNodes(uint16_t node1, uint16_t node2);
+    // check if frequencies should be halved now (after an update)
+    bool needsRescaling() const;
+    // rebuild the tree from halved frequencies of its leaves, the new tree keeps
+    // the sibling property, and nodes of the same frequency are ordered as given
+    // (leaves first for Vitter, internal nodes first for FGK, so the parent of NYT
+    // sibling directly follows it)
+    void rescale(bool leavesFirst);
+
+private:
+    // take a node from the pool and register it with given node number
+    uint16_t allocNode(uint16_t nodeNum, uint16_t parent, uint8_t symbol);
+
+    // go through the tree up to the root to write the code of the node
+    void writeNodeCode(uint16_t node, BitWriter &writer);
+    // go through the tree up to the root, until the code fills the whole word
+    // it returns the node where it stopped (root if the code is complete)
+    uint16_t collectNodeCode(uint16_t node, HuffCode &code);
+
+    // invalidate cached codes of all leaves in given subtree (after tree change)
+    void invalidateCodeCache(uint16_t node);
 
-    // clean-up resources of the given node
-    void deleteNode(const HuffNode *node);
+    // update decode table entries going through given node (after tree change)
+    void updateDecodeTable(uint16_t node);
+    // recursively fill decode table entries for given node and its code prefix
+    void fillDecodeTable(uint16_t node, uint64_t prefix, unsigned int depth);
+
+    // return the maximum depth of leaves in given subtree (relative to the node)
+    unsigned int getNodeDepth(uint16_t node) const;
     // print recursively given node to given stream (for debugging)
-    void printNode(const HuffNode *node, ostream &os);
+    void printNode(uint16_t node, ostream &os);
+};
+
+// adaptive Huffman tree updated by FGK algorithm
+class HuffTree : public AdaptHuffTree
+{
+public:
+    // initialize the Huffman FGK tree
+    HuffTree();
+
+    // update the tree based on given symbol
+    void update(uint8_t symbol);
+
+private:
+    // pool of blocks (there is never more blocks than nodes)
+    HuffBlock blocks[MAX_NODES];
+    uint16_t freeBlocks[MAX_NODES];
+    uint16_t freeBlockCount;
+
+    // increase frequency of given node, it must be the leader of its block
+    void incrementNode(uint16_t node);
+    // group all nodes to blocks again (after the tree is rebuilt)
+    void rebuildBlocks();
+
+    // get an unused block from the pool and make given node its leader
+    uint16_t allocBlock(uint16_t leader);
+    // return given block back to the pool
+    void freeBlock(uint16_t block);
 };
@@ -8,139 +8,187 @@
 
 #include <iostream>
 #include <unistd.h>
+#include <getopt.h>
 #include <fstream>
-#include <climits>
 #include <vector>
-#include <deque>
 #include <cstdint>
+#include <climits>
 
-#include "transform.hpp"
-#include "headers.hpp"
+#include "huffcodec.hpp"
+#include "batch.hpp"
+#include "chunks.hpp"
+#include "mapping.hpp"
+#include "stats.hpp"
+#include "error.hpp"
 
 using namespace std;
 
 const string HELP_MESSAGE =
 "USAGE:\n"
-"  huffman-codec [-cm] -i IFILE [-o OFILE]\n"
-"  huffman-codec [-cm] -a [-w WIDTH] -i IFILE [-o OFILE]\n"
-"  huffman-codec -d -i IFILE [-o OFILE] | -h\n"
+"  huffman-codec [-cemtsx] [-k SIZE] [-j N] -i IFILE [-o OFILE]\n"
+"  huffman-codec [-cemtsx] -a [-w WIDTH] [-k SIZE] [-j N] -i IFILE [-o OFILE]\n"
+"  huffman-codec [-cetsx] [-a] -p PRED [-w WIDTH] [-k SIZE] [-j N] -i IFILE [-o OFILE]\n"
+"  huffman-codec [-ctsx] -a -r [-w WIDTH] [-j N] -i IFILE [-o OFILE]\n"
+"  huffman-codec -d [-b] [-j N] [--range START:LEN | --rect X,Y,W,H] -i IFILE [-o OFILE]\n"
+"  huffman-codec -h\n"
+"  huffman-codec -c|-d [OPTION...] -D OUTDIR [-i DIR] [FILE...]\n"
+"  (all forms accept -v or --stats[=FORMAT])\n"
 "\n"
 "OPTION:\n"
 "  -c/-d  perform compression/decompression\n"
 "  -m     use differential model for preprocessing\n"
 "  -a     use adaptive block RLE (default: RLE)\n"
+"  -p     use 2D predictor: left, med, paeth, avg, or auto (best for each row)\n"
 "  -w     width of 2D data (default: 512)\n"
-"  -i     input file path\n"
-"  -o     output file path (default: b.out)\n"
+"  -t     use Vitter algorithm for Huffman tree (default: FGK)\n"
+"  -s     use static canonical Huffman coding (default: adaptive)\n"
+"  -x     use order-1 contexts, a tree for each of 32 buckets of the previous\n"
+"         byte (not with -s)\n"
+"  -r     code each row of blocks of adaptive block RLE independently (tiles),\n"
+"         so rectangles are decompressed fast\n"
+"  -b     decode bit by bit without lookup table (for verification)\n"
+"  -k     split data to independent chunks of SIZE bytes, K/M suffix may be used\n"
+"  -e     store seek index of chunks, so ranges are decompressed fast (chunks of\n"
+"         1M are used, unless -k is given)\n"
+"  -j     number of threads (default: all cores)\n"
+"  -i     input file path, - for standard input\n"
+"  -o     output file path (default: b.out), - for standard output\n"
+"  -D     batch mode, all given files (and files of -i directory) are processed\n"
+"         in parallel to OUTDIR, compressed files get .huff suffix\n"
+"  -v     print statistics of pipeline stages to stderr, same as --stats\n"
+"         (--stats=json prints them in JSON format)\n"
+"  --range  decompress only LEN bytes from offset START, only chunks covering\n"
+"           them are decompressed, K/M suffix may be used for both\n"
+"  --rect   decompress only rectangle of 2D data at X,Y of W x H size, only rows\n"
+"           of blocks covering it are decompressed for tiles\n"
 "  -h     show this help\n";
 
 
-// compress data based on several given options
-vector<uint8_t> huffCompress(
-    ifstream& ifs,
-    bool useDiffModel,
-    bool useAdaptRLE,
-    uint64_t matrixWidth)
+// long options (statistics, range and rectangle, all others are short)
+const struct option LONG_OPTIONS[] = {
+    {"stats", optional_argument, nullptr, 'v'},
+    {"range", required_argument, nullptr, 'R'},
+    {"rect", required_argument, nullptr, 'T'},
+    {nullptr, 0, nullptr, 0}
+};
+
+
+// write final data from vector to given output file path (- for standard output)
+// it returns false when the data cannot be written
+bool writeOutData(const vector<uint8_t> &vec, const string &filePath)
 {
-    // load input file to internal representation vector
-    vector<uint8_t> inData; // input data for Huffman tree (may be transformed before)
-    int c;
-    while ((c = ifs.get()) != EOF) {
-        inData.push_back(c);
+    ofstream ofs; // output file stream
+    if (filePath != "-") {
+        ofs.open(filePath, ios::out | ios::binary);
     }
-    ifs.close();
+    ostream &os = filePath == "-" ? cout : ofs;
 
-    // check valid matrix size (only when using adaptive block RLE)
-    if (useAdaptRLE && (inData.size() % matrixWidth) != 0)
+    os.write((char *) vec.data(), vec.size());
+    os.flush();
+    if (os.fail())
     {
-        cerr << "ERROR: invalid size of input 2D data detected\n";
-        exit(6);
+        cerr << "ERROR: cannot write to " << filePath << " output file\n";
+        return false;
     }
-    uint64_t matrixHeight = inData.size() / matrixWidth;
 
-    // perform required TRANSFORMATIONS
-    if (useDiffModel) {
-        applyDiffModel(inData);
+    return true; // ofs will be closed automatically (end of this scope)
+}
+
+// parse plain unsigned number to given variable
+// it returns false when the number is invalid (or too large)
+bool parseNumber(const string &str, uint64_t &number)
+{
+    if (str.empty() || str.find_first_not_of("0123456789") != string::npos) {
+        return false;
     }
-    if (useAdaptRLE) {
-        inData = applyAdaptRLE(inData, matrixWidth, matrixHeight);
+
+    try {
+        number = stoull(str);
     }
-    else {
-        inData = applyRLE(inData);
+    catch (const out_of_range &) {
+        return false;
     }
-    vector<bool> outBits = applyHuffman(inData);
+    return true;
+}
 
-    vector<uint8_t> outData;
-    // first header for Huffman coding
-    outData = createHuffHeader(inData.size(), useDiffModel, useAdaptRLE);
+// parse size in bytes with optional K (KiB) or M (MiB) suffix to given variable
+// it returns false when the size is invalid (or too large)
+bool parseSize(const string &str, uint64_t &size)
+{
+    size_t suffixIndex = min(str.find_first_not_of("0123456789"), str.size());
+    uint64_t number;
+    if (!parseNumber(str.substr(0, suffixIndex), number)) {
+        return false;
+    }
 
-    // then data; convert bit vector to byte array
-    for (size_t i = 0; i < outBits.size(); i += CHAR_BIT) {
-        uint8_t curByte = 0;
-        for (int j = 0; j < CHAR_BIT; j++) {
-            curByte = (curByte << 1) | outBits[i + j];
-        }
-        outData.push_back(curByte);
+    string suffix = str.substr(suffixIndex);
+    int shift = suffix == "K" ? 10 : suffix == "M" ? 20 : 0;
+    if ((shift == 0 && !suffix.empty()) || number > (UINT64_MAX >> shift)) {
+        return false;
+    }
+    size = number << shift;
+    return true;
+}
+
+// parse range of decompressed data in START:LEN format to given options
+// it returns false when the range is invalid (both parts are sizes, see above)
+bool parseRange(const string &str, CodecOptions &options)
+{
+    size_t colonIndex = str.find(':');
+    if (colonIndex == string::npos) {
+        return false;
     }
 
-    return outData;
+    return parseSize(str.substr(0, colonIndex), options.rangeStart) &&
+        parseSize(str.substr(colonIndex + 1), options.rangeSize) && options.rangeSize != 0;
 }
 
-// decompress data of the given input stream (based on its header)
-vector<uint8_t> huffDecompress(ifstream &ifs)
+// parse rectangle of 2D data in X,Y,W,H format to given options
+// it returns false when the rectangle is invalid (all parts are plain numbers)
+bool parseRect(const string &str, CodecOptions &options)
 {
-    // read total byte count to decode using Huffman
-    uint64_t byteCount;
-    ifs.read((char *)&byteCount, sizeof(uint64_t));
-    // read flags
-    int c = ifs.get();
-    bool diffModelUsed = (uint8_t(c) >> 7) & 0x01;
-    bool adaptRLEUsed = (uint8_t(c) >> 6) & 0x01;
-    if (c == EOF) // check if any errors during header reading
-    {
-        cerr << "ERROR: invalid or missing Huffman coding header\n";
-        ifs.close(); // close file handler before exit
-        exit(8);
-    }
-
-    // load input file
-    deque<bool> inData;
-    while ((c = ifs.get()) != EOF) {
-        for (int i = CHAR_BIT; i > 0; i--) {
-            inData.push_back((c >> (i - 1)) & 0x01);
+    vector<uint64_t> parts;
+    size_t partIndex = 0;
+    while (true)
+    {
+        size_t commaIndex = str.find(',', partIndex);
+        uint64_t part;
+        if (!parseNumber(str.substr(partIndex, commaIndex - partIndex), part)) {
+            return false;
         }
-    }
-    ifs.close();
+        parts.push_back(part);
 
-    // revert appropriate TRANSFORMATIONS
-    deque<uint8_t> huffDecoded = revertHuffman(inData, byteCount);
-    vector<uint8_t> outData;
-    if (adaptRLEUsed) {
-        outData = revertAdaptRLE(huffDecoded);
-    } else {
-        outData = revertRLE(huffDecoded);
+        if (commaIndex == string::npos) {
+            break;
+        }
+        partIndex = commaIndex + 1;
     }
-    if (diffModelUsed) {
-        revertDiffModel(outData);
+    if (parts.size() != 4) {
+        return false;
     }
 
-    return outData;
+    options.rectX = parts[0];
+    options.rectY = parts[1];
+    options.rectWidth = parts[2];
+    options.rectHeight = parts[3];
+    return options.rectWidth != 0 && options.rectHeight != 0;
 }
 
-
-// write final data from vector to given output file path
-void writeOutData(const vector<uint8_t> &vec, const string &filePath)
+// parse name of 2D predictor (none when invalid)
+Predictor parsePredictor(const string &str)
 {
-    ofstream ofs(filePath, ios::out | ios::binary); // output file stream
-    if (ofs.fail())
-    {
-        cerr << "ERROR: cannot write to " << filePath << " output file\n";
-        ofs.close(); // close file handler before exit
-        exit(7);
+    if (str == "left") {
+        return PRED_LEFT;
+    } else if (str == "med") {
+        return PRED_MED;
+    } else if (str == "paeth") {
+        return PRED_PAETH;
+    } else if (str == "avg") {
+        return PRED_AVG;
+    } else if (str == "auto") {
+        return PRED_AUTO;
     }
-
-    ofs.write((char *) vec.data(), vec.size());
-    // ofs will be closed automatically (end of this scope)
+    return PRED_NONE;
 }
 
 // redirect input to stderr, but also print a help hint
@@ -148,32 +196,131 @@ void cerrh(const char *s) {
     cerr << s << "try 'huffman-codec -h' for more information\n";
 }
 
+// print given statistics to stderr in given format (nothing when empty)
+void printStats(const CodecStats &stats, const string &format)
+{
+    if (format == "json") {
+        stats.printJSON(cerr);
+    } else if (format == "text") {
+        stats.print(cerr);
+    }
+}
+
+// process given files in batch mode, it prints errors and summary to stderr
+// it returns exit code of the first failed file (zero when all succeeded)
+int runBatchMode(
+    const vector<string> &paths,
+    const string &outDir,
+    bool useCompr,
+    const CodecOptions &options,
+    unsigned int threadCount)
+{
+    BatchResult result = runBatch(paths, outDir, useCompr, options, threadCount);
+    for (const BatchFailure &failure : result.failures) {
+        cerr << "ERROR: " << failure.filePath << ": " << failure.result.message << "\n";
+    }
+
+    // summary for better UX (may be suppressed by ignoring stderr)
+    double throughput = result.seconds > 0 ? result.inSize / result.seconds / 1e6 : 0;
+    cerr << "batch: " << result.fileCount - result.failures.size() << " of "
+         << result.fileCount << " files, " << result.inSize << " bytes to "
+         << result.outSize << " bytes in " << result.seconds << " s ("
+         << throughput << " MB/s)\n";
+
+    if (options.stats != nullptr) {
+        options.stats->setTotal(result.seconds, result.outSize);
+    }
+
+    return result.failures.empty() ? 0 : result.failures.front().result.code;
+}
+
 // entry point of program
 int main(int argc, char *argv[])
 {
     // default setup
     bool useCompr = true;
-    bool useDiffModel = false;
-    bool useAdaptRLE = false;
+    CodecOptions options;
+    unsigned int threadCount = 0; // all available cores
 
     string ifp; // input file path (empty by default constructor)
     string ofp = "b.out"; // default path
-    uint64_t matrixWidth = 512; // default value
+    string outDir; // output directory of batch mode (empty otherwise)
+
+    CodecStats stats;
+    string statsFormat; // empty when statistics are not collected
 
     // argument processing
     // options are designed to be more tolerant (yet they meet the assignment)
     int opt;
-    while ((opt = getopt(argc, argv, ":cdmai:o:w:h")) != -1)
+    uint64_t number; // parsed numeric argument
+    while ((opt = getopt_long(argc, argv, ":cdmatsxerbp:k:j:i:o:w:D:vh", LONG_OPTIONS, nullptr)) != -1)
     {
         switch (opt)
         {
         case 'c': useCompr = true; break;
         case 'd': useCompr = false; break;
-        case 'm': useDiffModel = true; break;
-        case 'a': useAdaptRLE = true; break;
+        case 'm': options.useDiffModel = true; break;
+        case 'a': options.useAdaptRLE = true; break;
+        case 't': options.useVitter = true; break;
+        case 's': options.useStatic = true; break;
+        case 'x': options.useContexts = true; break;
+        case 'e': options.useSeekIndex = true; break;
+        case 'r': options.useTiles = true; break;
+        case 'b': options.useDecodeTable = false; break;
+        case 'p': options.predictor = parsePredictor(optarg);
+            if (options.predictor == PRED_NONE)
+            {
+                cerrh("ERROR: unknown 2D predictor\n");
+                return 4;
+            }
+            break;
+        case 'k':
+            if (!parseSize(optarg, options.chunkSize) || options.chunkSize == 0 ||
+                options.chunkSize > MAX_CHUNK_SIZE)
+            {
+                cerrh("ERROR: invalid chunk size\n");
+                return 4;
+            }
+            break;
+        case 'j':
+            if (!parseNumber(optarg, number) || number > UINT_MAX)
+            {
+                cerrh("ERROR: invalid arguments\n");
+                return 4;
+            }
+            threadCount = number;
+            break;
         case 'i': ifp = optarg; break;
         case 'o': ofp = optarg; break;
-        case 'w': matrixWidth = stoull(optarg); break;
+        case 'D': outDir = optarg; break;
+        case 'w':
+            if (!parseNumber(optarg, options.matrixWidth))
+            {
+                cerrh("ERROR: invalid arguments\n");
+                return 4;
+            }
+            break;
+        case 'R':
+            if (!parseRange(optarg, options))
+            {
+                cerrh("ERROR: invalid range of decompressed data\n");
+                return 4;
+            }
+            break;
+        case 'T':
+            if (!parseRect(optarg, options))
+            {
+                cerrh("ERROR: invalid rectangle of 2D data\n");
+                return 4;
+            }
+            break;
+        case 'v': statsFormat = optarg == nullptr ? "text" : optarg;
+            if (statsFormat != "text" && statsFormat != "json")
+            {
+                cerrh("ERROR: unknown statistics format\n");
+                return 4;
+            }
+            break;
         case 'h':
             cout << HELP_MESSAGE;
             return 0; break;
@@ -186,36 +333,190 @@ int main(int argc, char *argv[])
         }
     }
 
+    // other arguments are files of batch mode
+    vector<string> batchPaths(argv + optind, argv + argc);
+    if (!outDir.empty() && !ifp.empty()) {
+        batchPaths.insert(batchPaths.begin(), ifp);
+    }
+
     // mandatory arguments check
-    if (ifp.empty())
+    if (outDir.empty() ? ifp.empty() : batchPaths.empty())
     {
         cerrh("ERROR: no input file path provided\n");
         return 3;
     }
-    if (useCompr && matrixWidth == 0)
+    if (useCompr && options.matrixWidth == 0)
     {
         cerrh("ERROR: invalid 2D data width\n");
         return 4;
     }
+    if (options.useDiffModel && options.predictor != PRED_NONE)
+    {
+        cerrh("ERROR: differential model cannot be used with 2D predictor\n");
+        return 4;
+    }
+    if (options.useStatic && options.useContexts)
+    {
+        cerrh("ERROR: contexts cannot be used with static Huffman coding\n");
+        return 4;
+    }
+    if (options.useTiles && !options.useAdaptRLE)
+    {
+        cerrh("ERROR: tiles can be used only with adaptive block RLE\n");
+        return 4;
+    }
+    if (options.useTiles && (options.useDiffModel || options.predictor != PRED_NONE))
+    {
+        cerrh("ERROR: tiles cannot be used with differential model or 2D predictor\n");
+        return 4;
+    }
+    if (options.useTiles && (options.chunkSize != 0 || options.useSeekIndex))
+    {
+        cerrh("ERROR: tiles cannot be used with chunks\n");
+        return 4;
+    }
+    if (useCompr && (options.usesRange() || options.usesRect()))
+    {
+        cerrh("ERROR: range or rectangle may be used only for decompression\n");
+        return 4;
+    }
+    if (options.usesRange() && options.usesRect())
+    {
+        cerrh("ERROR: range cannot be used with rectangle\n");
+        return 4;
+    }
 
-    // reading input file
-    ifstream ifs(ifp, ios::in | ios::binary); // input file stream
-    if (ifs.fail())
+    // piped input is always compressed in chunks, so it is never loaded at once
+    // (tiled data are always a single stream)
+    if (useCompr && ifp == "-" && options.chunkSize == 0 && !options.useTiles) {
+        options.chunkSize = DEFAULT_STREAM_CHUNK_SIZE;
+    }
+
+    // statistics are passed to all stages, they measure nothing without them
+    if (!statsFormat.empty()) {
+        options.stats = &stats;
+    }
+
+    if (!outDir.empty())
     {
-        cerr << "ERROR: given input file does not exist\n";
-        return 5;
+        int exitCode = runBatchMode(batchPaths, outDir, useCompr, options, threadCount);
+        printStats(stats, statsFormat);
+        return exitCode;
     }
 
-    // perform required operation
-    vector<uint8_t> outData; // alway array of bytes
-    if (useCompr) {
-        outData = huffCompress(ifs, useDiffModel, useAdaptRLE, matrixWidth);
-    } else {
-        outData = huffDecompress(ifs);
+    HuffCodec codec(threadCount);
+    HuffResult result;
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+    // regular input files are mapped to memory, other ones are read as streams
+    // (pages of mapped files are read lazily by the following stages)
+    StageTimer readTimer(options.stats);
+    InputMapping inMapping(ifp == "-" ? "" : ifp);
+    if (inMapping.isValid())
+    {
+        readTimer.stop("read", inMapping.getSize(), inMapping.getSize());
+
+        // the input must not be replaced while it is mapped, and only regular files
+        // are replaced by mapped ones
+        if (useCompr || ofp == "-" || inMapping.isSameFile(ofp) || !isMappableOutput(ofp))
+        {
+            vector<uint8_t> outData; // alway array of bytes
+            if (useCompr) {
+                result = codec.compress(inMapping.getData(), inMapping.getSize(), options, outData);
+            } else {
+                result = codec.decompress(inMapping.getData(), inMapping.getSize(), options, outData);
+            }
+
+            if (result.isOk())
+            {
+                StageTimer writeTimer(options.stats);
+                if (!writeOutData(outData, ofp)) {
+                    return 7;
+                }
+                writeTimer.stop("write", result.size, result.size);
+            }
+        }
+        else // decompressed data are written to mapped output file directly
+        {
+            OutputMapping outMapping(ofp);
+            if (!outMapping.isValid())
+            {
+                cerr << "ERROR: cannot write to " << ofp << " output file\n";
+                return 7;
+            }
+
+            result = codec.decompress(inMapping.getData(), inMapping.getSize(), options,
+                [&outMapping, &ofp](uint64_t size)
+                {
+                    uint8_t *outData = outMapping.resize(size);
+                    if (!outMapping.isValid()) {
+                        throw CodecError("cannot write to " + ofp + " output file", 7);
+                    }
+                    return outData;
+                });
+
+            // the output file is replaced only by valid data
+            if (result.isOk() && !outMapping.commit())
+            {
+                cerr << "ERROR: cannot write to " << ofp << " output file\n";
+                return 7;
+            }
+        }
+    }
+    else
+    {
+        // opening input file
+        ifstream ifs; // input file stream
+        if (ifp != "-")
+        {
+            ifs.open(ifp, ios::in | ios::binary);
+            if (ifs.fail())
+            {
+                cerr << "ERROR: given input file does not exist\n";
+                return 5;
+            }
+        }
+        istream &is = ifp == "-" ? cin : ifs;
+
+        // opening output file (before processing, so the output may be streamed)
+        ofstream ofs; // output file stream
+        if (ofp != "-")
+        {
+            ofs.open(ofp, ios::out | ios::binary);
+            if (ofs.fail())
+            {
+                cerr << "ERROR: cannot write to " << ofp << " output file\n";
+                return 7;
+            }
+        }
+        ostream &os = ofp == "-" ? cout : ofs;
+
+        // perform required operation
+        if (useCompr) {
+            result = codec.compress(is, os, options);
+        } else {
+            result = codec.decompress(is, os, options);
+        }
+
+        os.flush();
+        if (result.isOk() && os.fail())
+        {
+            cerr << "ERROR: cannot write to " << ofp << " output file\n";
+            return 7;
+        }
+        // both files will be closed automatically (end of this scope)
+    }
+
+    if (!result.isOk())
+    {
+        cerr << "ERROR: " << result.message << "\n";
+        return result.code;
     }
 
     // info for better UX (may be suppressed by ignoring stderr)
-    cerr << "writing " << outData.size() << " bytes to " << ofp << "\n";
-    
-    writeOutData(outData, ofp);
+    cerr << "writing " << result.size << " bytes to " << ofp << "\n";
+
+    chrono::duration<double> seconds = chrono::steady_clock::now() - startTime;
+    stats.setTotal(seconds.count(), result.size);
+    printStats(stats, statsFormat);
 }
@@ -0,0 +1,251 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of memory-mapped input and output files.
+//------------------------------------------------------------------------------
+
+#include "mapping.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::vector;
+using std::to_string;
+
+// -------------------------- INPUT --------------------------------------------
+
+InputMapping::InputMapping(const string &filePath) :
+    data(nullptr), size(0), valid(false), device(0), inode(0)
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+
+    // only regular files may be mapped
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode))
+    {
+        close(fd);
+        return;
+    }
+
+    device = fileStat.st_dev;
+    inode = fileStat.st_ino;
+    size = fileStat.st_size;
+    if (size != 0) // empty files cannot be mapped
+    {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fd);
+            return;
+        }
+
+        data = (uint8_t *) mapped;
+        madvise(data, size, MADV_SEQUENTIAL); // read ahead, free pages behind
+    }
+
+    close(fd); // the mapping stays valid
+    valid = true;
+}
+
+InputMapping::~InputMapping()
+{
+    if (data != nullptr) {
+        munmap(data, size);
+    }
+}
+
+bool InputMapping::isValid() const {
+    return valid;
+}
+
+const uint8_t* InputMapping::getData() const {
+    return data;
+}
+
+uint64_t InputMapping::getSize() const {
+    return size;
+}
+
+bool InputMapping::isSameFile(const string &filePath) const
+{
+    struct stat fileStat;
+    return valid && stat(filePath.c_str(), &fileStat) == 0 &&
+        fileStat.st_dev == device && fileStat.st_ino == inode;
+}
+
+// -------------------------- OUTPUT -------------------------------------------
+
+OutputMapping::OutputMapping(const string &filePath) :
+    filePath(filePath), data(nullptr), size(0)
+{
+    // the file must be opened for reading too, so it can be mapped
+    size_t slashIndex = filePath.rfind('/');
+    string dirPath = slashIndex == string::npos ? "." : filePath.substr(0, slashIndex + 1);
+    fd = open(dirPath.c_str(), O_TMPFILE | O_RDWR, 0600);
+
+    // file systems without unnamed files get a named one
+    if (fd == -1)
+    {
+        tempPath = filePath + ".XXXXXX";
+        vector<char> pathTemplate(tempPath.begin(), tempPath.end());
+        pathTemplate.push_back('\0');
+        fd = mkstemp(pathTemplate.data());
+        tempPath = fd != -1 ? pathTemplate.data() : "";
+    }
+    valid = fd != -1;
+    if (!valid) {
+        return;
+    }
+
+    // the replaced file keeps its permissions, a new one gets the default ones
+    struct stat fileStat;
+    mode_t mode;
+    if (stat(filePath.c_str(), &fileStat) == 0) {
+        mode = fileStat.st_mode & 07777;
+    } else
+    {
+        mode_t mask = umask(0);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+    fchmod(fd, mode);
+}
+
+OutputMapping::~OutputMapping()
+{
+    if (data != nullptr) {
+        munmap(data, size);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    if (!tempPath.empty()) {
+        unlink(tempPath.c_str());
+    }
+}
+
+bool OutputMapping::isValid() const {
+    return valid;
+}
+
+uint8_t* OutputMapping::resize(uint64_t newSize)
+{
+    if (!valid || data != nullptr || !buffer.empty() || ftruncate(fd, newSize) == -1)
+    {
+        valid = false;
+        return nullptr;
+    }
+
+    size = newSize;
+    if (size == 0) {
+        return nullptr;
+    }
+
+    // writes to mapped holes would fault on a full disk, so blocks are reserved first
+    // (when it fails, the data are buffered and the error is reported when written)
+    void *mapped = MAP_FAILED;
+    if (posix_fallocate(fd, 0, size) == 0) {
+        mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mapped == MAP_FAILED)
+    {
+        buffer.resize(size);
+        return buffer.data();
+    }
+
+    data = (uint8_t *) mapped;
+    madvise(data, size, MADV_SEQUENTIAL);
+    return data;
+}
+
+bool OutputMapping::commit()
+{
+    if (!valid) {
+        return false;
+    }
+
+    if (data != nullptr)
+    {
+        munmap(data, size);
+        data = nullptr;
+    }
+
+    // buffered data are written now, so a full disk is reported
+    uint64_t writtenSize = 0;
+    while (writtenSize < buffer.size())
+    {
+        ssize_t curSize = pwrite(fd, buffer.data() + writtenSize,
+            buffer.size() - writtenSize, writtenSize);
+        if (curSize == -1 && errno == EINTR) {
+            continue;
+        }
+        if (curSize <= 0)
+        {
+            valid = false;
+            return false;
+        }
+        writtenSize += curSize;
+    }
+
+    bool linked = !tempPath.empty() || linkTempFile();
+    bool closed = close(fd) == 0;
+    fd = -1;
+
+    valid = linked && closed && rename(tempPath.c_str(), filePath.c_str()) == 0;
+    if (valid) {
+        tempPath.clear(); // nothing to remove
+    }
+    return valid;
+}
+
+bool OutputMapping::linkTempFile()
+{
+    // a unique name is reserved by creating a file, which is replaced by the link
+    // (it is not overwritten by the link, so it is removed first)
+    string fdPath = "/proc/self/fd/" + to_string(fd);
+    for (int attempt = 0; attempt < 16; attempt++)
+    {
+        string newPath = filePath + ".XXXXXX";
+        vector<char> pathTemplate(newPath.begin(), newPath.end());
+        pathTemplate.push_back('\0');
+        int newFd = mkstemp(pathTemplate.data());
+        if (newFd == -1) {
+            return false;
+        }
+        close(newFd);
+        unlink(pathTemplate.data());
+
+        int linkResult = linkat(
+            AT_FDCWD, fdPath.c_str(), AT_FDCWD, pathTemplate.data(), AT_SYMLINK_FOLLOW);
+        if (linkResult == 0)
+        {
+            tempPath = pathTemplate.data();
+            return true;
+        }
+        if (errno != EEXIST) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// -------------------------- HELPER FUNCTIONS ---------------------------------
+
+bool isMappableOutput(const string &filePath)
+{
+    struct stat fileStat;
+    if (lstat(filePath.c_str(), &fileStat) == -1) {
+        return errno == ENOENT;
+    }
+    return S_ISREG(fileStat.st_mode) && fileStat.st_nlink == 1;
+}
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of memory-mapped input and output files.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+using std::string;
+using std::vector;
+
+
+// whole input file mapped to memory for reading (read sequentially)
+class InputMapping
+{
+public:
+    // map given file, the mapping fails for files that cannot be mapped (e.g., pipes)
+    InputMapping(const string &filePath);
+    // unmap the file
+    ~InputMapping();
+
+    // return whether the file was mapped successfully
+    bool isValid() const;
+    // return file data, they exist for the whole life of the mapping
+    const uint8_t* getData() const;
+    uint64_t getSize() const;
+    // return whether given path refers to the mapped file
+    bool isSameFile(const string &filePath) const;
+
+private:
+    uint8_t *data; // null for empty files
+    uint64_t size;
+    bool valid;
+    dev_t device; // identity of the mapped file
+    ino_t inode;
+};
+
+// output file mapped to memory for writing, its size must be set first
+// data are written to a temporary file in the same directory, which replaces the
+// given file only when committed, so the file is never truncated before that
+// the temporary file is unnamed until committed (if supported by the file system),
+// so nothing is left behind when the process crashes
+class OutputMapping
+{
+public:
+    // create a temporary file for given file, nothing is mapped yet
+    OutputMapping(const string &filePath);
+    // unmap and close the file, the temporary file is removed if not committed
+    ~OutputMapping();
+
+    // return whether the file was opened (and mapped) successfully
+    bool isValid() const;
+    // set the file size and map it, it returns the target for file data
+    // blocks of the file are reserved first, when it fails (e.g., the disk is full),
+    // a buffer is returned instead, which is written to the file when committed
+    // the target is null when the file cannot be resized (or for zero size)
+    uint8_t* resize(uint64_t newSize);
+    // replace the given file by the written data, it returns false on failure
+    bool commit();
+
+private:
+    string filePath;
+    string tempPath; // empty for an unnamed temporary file
+    int fd; // file descriptor
+    uint8_t *data; // mapped file data
+    uint64_t size;
+    vector<uint8_t> buffer; // data when the file cannot be mapped
+    bool valid;
+
+    // link the unnamed temporary file to a new temporary path in the same directory
+    bool linkTempFile();
+};
+
+// return whether given output file may be replaced by a mapped one, it must be
+// a regular file without other links, or it must not exist yet
+bool isMappableOutput(const string &filePath);
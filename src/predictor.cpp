@@ -0,0 +1,186 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of 2D predictors of pixel values.
+//------------------------------------------------------------------------------
+
+#include "predictor.hpp"
+
+#include <cstdlib>
+
+using std::abs;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// each predictor gets left (a), upper (b), and upper left (c) neighbours
+
+struct LeftPredictor
+{
+    static uint8_t predict(int a, int, int) {
+        return a;
+    }
+};
+
+struct MEDPredictor
+{
+    static uint8_t predict(int a, int b, int c)
+    {
+        if (c >= (a > b ? a : b)) {
+            return a < b ? a : b; // edge above or on the left
+        }
+        if (c <= (a < b ? a : b)) {
+            return a > b ? a : b;
+        }
+        return a + b - c; // smooth area
+    }
+};
+
+struct PaethPredictor
+{
+    static uint8_t predict(int a, int b, int c)
+    {
+        // choose the neighbour closest to the gradient estimation
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+
+        if (pa <= pb && pa <= pc) {
+            return a;
+        }
+        return pb <= pc ? b : c;
+    }
+};
+
+struct AvgPredictor
+{
+    static uint8_t predict(int a, int b, int) {
+        return (a + b) >> 1;
+    }
+};
+
+// compute residuals of one row (upper row is zeros for the first row)
+template <typename Pred>
+void predictRow(const uint8_t *row, const uint8_t *upRow, uint64_t width, uint8_t *tarRow)
+{
+    int a = 0, c = 0;
+    for (uint64_t x = 0; x < width; x++)
+    {
+        int b = upRow[x];
+        tarRow[x] = row[x] - Pred::predict(a, b, c); // truncated result of underflow
+        a = row[x];
+        c = b;
+    }
+}
+
+// recover one row from its residuals (in situ), upper row is already recovered
+template <typename Pred>
+void unpredictRow(uint8_t *row, const uint8_t *upRow, uint64_t width)
+{
+    int a = 0, c = 0;
+    for (uint64_t x = 0; x < width; x++)
+    {
+        int b = upRow[x];
+        row[x] += Pred::predict(a, b, c); // may overflow (truncated)
+        a = row[x];
+        c = b;
+    }
+}
+
+// compute residuals of one row with given predictor
+void predictRow(
+    uint8_t predictor,
+    const uint8_t *row,
+    const uint8_t *upRow,
+    uint64_t width,
+    uint8_t *tarRow)
+{
+    switch (predictor)
+    {
+    case PRED_MED: predictRow<MEDPredictor>(row, upRow, width, tarRow); break;
+    case PRED_PAETH: predictRow<PaethPredictor>(row, upRow, width, tarRow); break;
+    case PRED_AVG: predictRow<AvgPredictor>(row, upRow, width, tarRow); break;
+    default: predictRow<LeftPredictor>(row, upRow, width, tarRow); break;
+    }
+}
+
+// -------------------------- PREDICTORS ---------------------------------------
+
+vector<uint8_t> selectRowPredictors(
+    const vector<uint8_t> &matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    ThreadPool &threadPool)
+{
+    vector<uint8_t> zeroRow(matrixWidth);
+    vector<uint8_t> rowPredictors(matrixHeight);
+    threadPool.parallelFor(matrixHeight, [&](uint64_t y)
+    {
+        const uint8_t *row = matrix.data() + y * matrixWidth;
+        const uint8_t *upRow = y == 0 ? zeroRow.data() : row - matrixWidth;
+        vector<uint8_t> residuals(matrixWidth);
+
+        uint64_t bestCost = UINT64_MAX;
+        for (uint8_t predictor = PRED_LEFT; predictor < PRED_AUTO; predictor++)
+        {
+            predictRow(predictor, row, upRow, matrixWidth, residuals.data());
+
+            // residuals are signed values
+            uint64_t cost = 0;
+            for (uint8_t residual : residuals) {
+                cost += abs(int8_t(residual));
+            }
+
+            if (cost < bestCost)
+            {
+                rowPredictors[y] = predictor;
+                bestCost = cost;
+            }
+        }
+    });
+
+    return rowPredictors;
+}
+
+void applyPredictors(
+    vector<uint8_t> &matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    const vector<uint8_t> &rowPredictors,
+    ThreadPool &threadPool)
+{
+    // not in situ, so rows are independent
+    vector<uint8_t> zeroRow(matrixWidth);
+    vector<uint8_t> residuals(matrix.size());
+    threadPool.parallelFor(matrixHeight, [&](uint64_t y)
+    {
+        const uint8_t *row = matrix.data() + y * matrixWidth;
+        const uint8_t *upRow = y == 0 ? zeroRow.data() : row - matrixWidth;
+        predictRow(rowPredictors[y], row, upRow, matrixWidth, residuals.data() + y * matrixWidth);
+    });
+
+    matrix.swap(residuals);
+}
+
+void revertPredictors(
+    uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    const vector<uint8_t> &rowPredictors)
+{
+    vector<uint8_t> zeroRow(matrixWidth);
+    for (uint64_t y = 0; y < matrixHeight; y++)
+    {
+        uint8_t *row = matrix + y * matrixWidth;
+        const uint8_t *upRow = y == 0 ? zeroRow.data() : row - matrixWidth;
+
+        switch (rowPredictors[y])
+        {
+        case PRED_MED: unpredictRow<MEDPredictor>(row, upRow, matrixWidth); break;
+        case PRED_PAETH: unpredictRow<PaethPredictor>(row, upRow, matrixWidth); break;
+        case PRED_AVG: unpredictRow<AvgPredictor>(row, upRow, matrixWidth); break;
+        default: unpredictRow<LeftPredictor>(row, upRow, matrixWidth); break;
+        }
+    }
+}
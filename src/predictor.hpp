@@ -0,0 +1,53 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of 2D predictors of pixel values.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "threadpool.hpp"
+
+using std::vector;
+
+// predictors of pixel values from their left, upper, and upper left neighbours
+// (neighbours outside of 2D data are zero), the first four fit to two bits
+enum Predictor : uint8_t
+{
+    PRED_LEFT, // left neighbour (within the row only)
+    PRED_MED, // median edge detector (JPEG-LS, LOCO-I)
+    PRED_PAETH, // Paeth predictor (PNG)
+    PRED_AVG, // average of upper and left neighbours
+    PRED_AUTO, // the best one of the above for each row
+    PRED_NONE
+};
+
+#define PRED_ROW_BITS 2 // bits of one row predictor (automatic selection)
+
+
+// choose the best predictor for each row of the matrix (based on the sum of
+// absolute residuals, i.e., their magnitude), rows are evaluated in parallel
+vector<uint8_t> selectRowPredictors(
+    const vector<uint8_t> &matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    ThreadPool &threadPool);
+
+// replace pixel values by residuals of their prediction (two's complement)
+// given predictor is used for each row, rows are processed in parallel
+void applyPredictors(
+    vector<uint8_t> &matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    const vector<uint8_t> &rowPredictors,
+    ThreadPool &threadPool);
+// recover pixel values from residuals of their prediction (in situ)
+void revertPredictors(
+    uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    const vector<uint8_t> &rowPredictors);
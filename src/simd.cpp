@@ -0,0 +1,367 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of vectorized kernels selected at runtime.
+//------------------------------------------------------------------------------
+
+#include "simd.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define MAX_RLE_RUN 258 // 255 + 3 (longer runs are split)
+
+// find the first run of at least three same bytes in given range of data
+// it returns the end of range when there is no such run
+typedef uint64_t (*FindRunFunc)(const uint8_t *data, uint64_t begin, uint64_t end);
+// find the end of run starting at given index (the first different byte)
+typedef uint64_t (*FindRunEndFunc)(const uint8_t *data, uint64_t begin, uint64_t end);
+
+// -------------------------- SCALAR -------------------------------------------
+
+void applyDiffScalar(uint8_t *data, uint64_t size, uint8_t prevVal)
+{
+    for (uint64_t i = 0; i < size; i++)
+    {
+        uint8_t curVal = data[i];
+        data[i] = curVal - prevVal; // truncated result of underflow
+        prevVal = curVal;
+    }
+}
+
+void revertDiffScalar(uint8_t *data, uint64_t size, uint8_t prevVal)
+{
+    for (uint64_t i = 0; i < size; i++)
+    {
+        data[i] += prevVal; // may overflow (truncated)
+        prevVal = data[i];
+    }
+}
+
+uint64_t findRunScalar(const uint8_t *data, uint64_t begin, uint64_t end)
+{
+    for (uint64_t i = begin; i + 2 < end; i++)
+    {
+        if (data[i] == data[i + 1] && data[i + 1] == data[i + 2]) {
+            return i;
+        }
+    }
+    return end;
+}
+
+uint64_t findRunEndScalar(const uint8_t *data, uint64_t begin, uint64_t end)
+{
+    uint64_t i = begin;
+    while (i < end && data[i] == data[begin]) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef SIMD_X86
+
+// -------------------------- SSE2 ---------------------------------------------
+
+__attribute__((target("sse2")))
+void applyDiffSSE2(uint8_t *data, uint64_t size)
+{
+    uint64_t vecSize = size & ~uint64_t(15);
+    __m128i prevVec = _mm_setzero_si128(); // only its last byte is used
+
+    for (uint64_t i = 0; i < vecSize; i += 16)
+    {
+        __m128i curVec = _mm_loadu_si128((__m128i *) (data + i));
+        // items shifted by one byte, the first one comes from previous vector
+        __m128i shiftVec = _mm_or_si128(
+            _mm_slli_si128(curVec, 1), _mm_srli_si128(prevVec, 15));
+        _mm_storeu_si128((__m128i *) (data + i), _mm_sub_epi8(curVec, shiftVec));
+        prevVec = curVec;
+    }
+
+    // the last item is already overwritten, so take it from the register
+    uint8_t prevVal = _mm_cvtsi128_si32(_mm_srli_si128(prevVec, 15));
+    applyDiffScalar(data + vecSize, size - vecSize, prevVal);
+}
+
+__attribute__((target("sse2")))
+void revertDiffSSE2(uint8_t *data, uint64_t size)
+{
+    uint64_t vecSize = size & ~uint64_t(15);
+    __m128i carryVec = _mm_setzero_si128(); // last item of previous vector in all bytes
+
+    for (uint64_t i = 0; i < vecSize; i += 16)
+    {
+        // prefix sum in log steps
+        __m128i curVec = _mm_loadu_si128((__m128i *) (data + i));
+        curVec = _mm_add_epi8(curVec, _mm_slli_si128(curVec, 1));
+        curVec = _mm_add_epi8(curVec, _mm_slli_si128(curVec, 2));
+        curVec = _mm_add_epi8(curVec, _mm_slli_si128(curVec, 4));
+        curVec = _mm_add_epi8(curVec, _mm_slli_si128(curVec, 8));
+        curVec = _mm_add_epi8(curVec, carryVec);
+        _mm_storeu_si128((__m128i *) (data + i), curVec);
+
+        // broadcast the last item
+        carryVec = _mm_srli_si128(curVec, 15);
+        carryVec = _mm_unpacklo_epi8(carryVec, carryVec);
+        carryVec = _mm_unpacklo_epi16(carryVec, carryVec);
+        carryVec = _mm_shuffle_epi32(carryVec, 0);
+    }
+
+    revertDiffScalar(data + vecSize, size - vecSize, _mm_cvtsi128_si32(carryVec));
+}
+
+__attribute__((target("sse2")))
+uint64_t findRunSSE2(const uint8_t *data, uint64_t begin, uint64_t end)
+{
+    uint64_t i = begin;
+    for (; i + 2 + 16 <= end; i += 16)
+    {
+        // compare each byte with two following ones
+        __m128i vec0 = _mm_loadu_si128((__m128i *) (data + i));
+        __m128i vec1 = _mm_loadu_si128((__m128i *) (data + i + 1));
+        __m128i vec2 = _mm_loadu_si128((__m128i *) (data + i + 2));
+        __m128i runVec = _mm_and_si128(_mm_cmpeq_epi8(vec0, vec1), _mm_cmpeq_epi8(vec1, vec2));
+
+        unsigned int runMask = _mm_movemask_epi8(runVec);
+        if (runMask != 0) {
+            return i + __builtin_ctz(runMask);
+        }
+    }
+    return findRunScalar(data, i, end);
+}
+
+__attribute__((target("sse2")))
+uint64_t findRunEndSSE2(const uint8_t *data, uint64_t begin, uint64_t end)
+{
+    __m128i runVec = _mm_set1_epi8(data[begin]);
+    uint64_t i = begin;
+    for (; i + 16 <= end; i += 16)
+    {
+        __m128i curVec = _mm_loadu_si128((__m128i *) (data + i));
+        unsigned int diffMask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(curVec, runVec)) & 0xffff;
+        if (diffMask != 0) {
+            return i + __builtin_ctz(diffMask);
+        }
+    }
+    while (i < end && data[i] == data[begin]) {
+        i++;
+    }
+    return i;
+}
+
+// -------------------------- AVX2 ---------------------------------------------
+
+__attribute__((target("avx2")))
+void applyDiffAVX2(uint8_t *data, uint64_t size)
+{
+    uint64_t vecSize = size & ~uint64_t(31);
+    __m256i prevVec = _mm256_setzero_si256(); // only its last byte is used
+
+    for (uint64_t i = 0; i < vecSize; i += 32)
+    {
+        __m256i curVec = _mm256_loadu_si256((__m256i *) (data + i));
+        // items shifted by one byte across both lanes (upper lane of previous vector
+        // and lower lane of current one are the source of shifted-in bytes)
+        __m256i crossVec = _mm256_permute2x128_si256(prevVec, curVec, 0x21);
+        __m256i shiftVec = _mm256_alignr_epi8(curVec, crossVec, 15);
+        _mm256_storeu_si256((__m256i *) (data + i), _mm256_sub_epi8(curVec, shiftVec));
+        prevVec = curVec;
+    }
+
+    // the last item is already overwritten, so take it from the register
+    applyDiffScalar(data + vecSize, size - vecSize, _mm256_extract_epi8(prevVec, 31));
+}
+
+__attribute__((target("avx2")))
+void revertDiffAVX2(uint8_t *data, uint64_t size)
+{
+    uint64_t vecSize = size & ~uint64_t(31);
+    __m256i lastIndexVec = _mm256_set1_epi8(15);
+    __m256i carryVec = _mm256_setzero_si256(); // last item of previous vector in all bytes
+
+    for (uint64_t i = 0; i < vecSize; i += 32)
+    {
+        // prefix sum in log steps (within both lanes separately)
+        __m256i curVec = _mm256_loadu_si256((__m256i *) (data + i));
+        curVec = _mm256_add_epi8(curVec, _mm256_slli_si256(curVec, 1));
+        curVec = _mm256_add_epi8(curVec, _mm256_slli_si256(curVec, 2));
+        curVec = _mm256_add_epi8(curVec, _mm256_slli_si256(curVec, 4));
+        curVec = _mm256_add_epi8(curVec, _mm256_slli_si256(curVec, 8));
+
+        // add the last item of the lower lane to the upper lane
+        __m256i laneLastVec = _mm256_shuffle_epi8(curVec, lastIndexVec);
+        __m256i lowerLastVec = _mm256_permute2x128_si256(laneLastVec, laneLastVec, 0x08);
+        curVec = _mm256_add_epi8(curVec, lowerLastVec);
+
+        curVec = _mm256_add_epi8(curVec, carryVec);
+        _mm256_storeu_si256((__m256i *) (data + i), curVec);
+
+        // broadcast the last item
+        laneLastVec = _mm256_shuffle_epi8(curVec, lastIndexVec);
+        carryVec = _mm256_permute2x128_si256(laneLastVec, laneLastVec, 0x11);
+    }
+
+    revertDiffScalar(data + vecSize, size - vecSize, _mm256_extract_epi8(carryVec, 0));
+}
+
+__attribute__((target("avx2")))
+uint64_t findRunAVX2(const uint8_t *data, uint64_t begin, uint64_t end)
+{
+    uint64_t i = begin;
+    for (; i + 2 + 32 <= end; i += 32)
+    {
+        // compare each byte with two following ones
+        __m256i vec0 = _mm256_loadu_si256((__m256i *) (data + i));
+        __m256i vec1 = _mm256_loadu_si256((__m256i *) (data + i + 1));
+        __m256i vec2 = _mm256_loadu_si256((__m256i *) (data + i + 2));
+        __m256i runVec = _mm256_and_si256(
+            _mm256_cmpeq_epi8(vec0, vec1), _mm256_cmpeq_epi8(vec1, vec2));
+
+        uint32_t runMask = _mm256_movemask_epi8(runVec);
+        if (runMask != 0) {
+            return i + __builtin_ctz(runMask);
+        }
+    }
+    return findRunScalar(data, i, end);
+}
+
+__attribute__((target("avx2")))
+uint64_t findRunEndAVX2(const uint8_t *data, uint64_t begin, uint64_t end)
+{
+    __m256i runVec = _mm256_set1_epi8(data[begin]);
+    uint64_t i = begin;
+    for (; i + 32 <= end; i += 32)
+    {
+        __m256i curVec = _mm256_loadu_si256((__m256i *) (data + i));
+        uint32_t diffMask = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(curVec, runVec)));
+        if (diffMask != 0) {
+            return i + __builtin_ctz(diffMask);
+        }
+    }
+    while (i < end && data[i] == data[begin]) {
+        i++;
+    }
+    return i;
+}
+
+#endif // SIMD_X86
+
+// -------------------------- DISPATCH -----------------------------------------
+
+SimdLevel detectSimdLevel()
+{
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SIMD_SSE2;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel getSimdLevel()
+{
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+const char* getSimdName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SIMD_AVX2: return "AVX2";
+    case SIMD_SSE2: return "SSE2";
+    default: return "scalar";
+    }
+}
+
+void applyDiffKernel(uint8_t *data, uint64_t size, SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef SIMD_X86
+    case SIMD_AVX2: applyDiffAVX2(data, size); break;
+    case SIMD_SSE2: applyDiffSSE2(data, size); break;
+#endif
+    default: applyDiffScalar(data, size, 0); break;
+    }
+}
+
+void revertDiffKernel(uint8_t *data, uint64_t size, SimdLevel level)
+{
+    switch (level)
+    {
+#ifdef SIMD_X86
+    case SIMD_AVX2: revertDiffAVX2(data, size); break;
+    case SIMD_SSE2: revertDiffSSE2(data, size); break;
+#endif
+    default: revertDiffScalar(data, size, 0); break;
+    }
+}
+
+uint64_t applyRLEKernel(const uint8_t *data, uint64_t size, uint8_t *tarData, SimdLevel level)
+{
+    FindRunFunc findRun = findRunScalar;
+    FindRunEndFunc findRunEnd = findRunEndScalar;
+#ifdef SIMD_X86
+    if (level == SIMD_AVX2)
+    {
+        findRun = findRunAVX2;
+        findRunEnd = findRunEndAVX2;
+    }
+    else if (level == SIMD_SSE2)
+    {
+        findRun = findRunSSE2;
+        findRunEnd = findRunEndSSE2;
+    }
+#endif
+
+    if (size == 0) {
+        return 0;
+    }
+
+    // the last byte is excluded from matching, so it is never a part of a run
+    uint64_t end = size - 1;
+    uint8_t *tarBegin = tarData;
+    uint64_t i = 0;
+    while (i < end)
+    {
+        // bytes before the run are copied (shorter runs are not encoded)
+        uint64_t runBegin = findRun(data, i, end);
+        memcpy(tarData, data + i, runBegin - i);
+        tarData += runBegin - i;
+        if (runBegin == end) {
+            break;
+        }
+
+        uint64_t runEnd = findRunEnd(data, runBegin, end);
+        uint64_t runLength = runEnd - runBegin;
+        uint8_t runByte = data[runBegin];
+
+        // three bytes directly, then the number of remaining ones
+        while (runLength >= 3)
+        {
+            uint64_t partLength = runLength < MAX_RLE_RUN ? runLength : MAX_RLE_RUN;
+            tarData[0] = tarData[1] = tarData[2] = runByte;
+            tarData[3] = partLength - 3;
+            tarData += 4;
+            runLength -= partLength;
+        }
+        for (; runLength > 0; runLength--) { // too short rest of the run
+            *tarData++ = runByte;
+        }
+
+        i = runEnd;
+    }
+    *tarData++ = data[end];
+
+    return tarData - tarBegin;
+}
@@ -0,0 +1,40 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of vectorized kernels selected at runtime.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+// instruction sets of kernels (ordered from the slowest one)
+enum SimdLevel
+{
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+
+// return the best instruction set supported by the CPU (detected once)
+SimdLevel getSimdLevel();
+// return the name of given instruction set
+const char* getSimdName(SimdLevel level);
+
+// transform bytes to their differences (in situ), see applyDiffModel
+// given level must be supported by the CPU
+void applyDiffKernel(uint8_t *data, uint64_t size, SimdLevel level = getSimdLevel());
+// revert the differences (in situ), it is a prefix sum, see revertDiffModel
+// given level must be supported by the CPU
+void revertDiffKernel(uint8_t *data, uint64_t size, SimdLevel level = getSimdLevel());
+
+// apply RLE (MNP-5 Microcom format) to given data, see applyRLE
+// target data must have space for size + size / 3 + 1 bytes (worst case)
+// it returns the number of written bytes
+uint64_t applyRLEKernel(
+    const uint8_t *data,
+    uint64_t size,
+    uint8_t *tarData,
+    SimdLevel level = getSimdLevel());
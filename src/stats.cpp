@@ -0,0 +1,203 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of statistics collected during compression and decompression.
+//------------------------------------------------------------------------------
+
+#include "stats.hpp"
+
+#include <iomanip>
+#include <algorithm>
+
+using std::lock_guard;
+using std::max;
+using std::setw;
+using std::left;
+using std::right;
+using std::fixed;
+using std::setprecision;
+using std::chrono::duration;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// return throughput of given stage in MB/s (based on its input)
+double getThroughput(const StageStats &stage) {
+    return stage.seconds > 0 ? stage.inSize / stage.seconds / 1e6 : 0;
+}
+
+// return the ratio of given values (zero when undefined)
+double getRatio(uint64_t value1, uint64_t value2) {
+    return value2 > 0 ? double(value1) / value2 : 0;
+}
+
+void printStage(ostream &os, const StageStats &stage)
+{
+    os << left << setw(20) << stage.name << right
+       << setw(12) << stage.seconds * 1e3
+       << setw(14) << stage.inSize
+       << setw(14) << stage.outSize
+       << setw(14) << getThroughput(stage) << "\n";
+}
+
+void printStageJSON(ostream &os, const StageStats &stage)
+{
+    os << "{\"name\": \"" << stage.name << "\", \"seconds\": " << stage.seconds
+       << ", \"in_bytes\": " << stage.inSize << ", \"out_bytes\": " << stage.outSize
+       << ", \"mbps\": " << getThroughput(stage) << "}";
+}
+
+// -------------------------- CODEC STATISTICS ---------------------------------
+
+void CodecStats::addStage(const string &name, double seconds, uint64_t inSize, uint64_t outSize)
+{
+    lock_guard<mutex> lock(statsMutex);
+
+    for (StageStats &stage : stages)
+    {
+        if (stage.name == name)
+        {
+            stage.seconds += seconds;
+            stage.inSize += inSize;
+            stage.outSize += outSize;
+            return;
+        }
+    }
+    stages.push_back({name, seconds, inSize, outSize});
+}
+
+void CodecStats::addHuffStats(const HuffStats &stats)
+{
+    lock_guard<mutex> lock(statsMutex);
+
+    huffStats.symbolCount += stats.symbolCount;
+    huffStats.codeBitCount += stats.codeBitCount;
+    huffStats.maxDepth = max(huffStats.maxDepth, stats.maxDepth);
+    huffStats.swapCount += stats.swapCount;
+    huffStats.escapeCount += stats.escapeCount;
+    huffStats.cacheHits += stats.cacheHits;
+    huffStats.cacheLookups += stats.cacheLookups;
+    huffUsed = true;
+}
+
+void CodecStats::addAdaptRLEStats(uint64_t blockSize, uint64_t horBlockCount, uint64_t verBlockCount)
+{
+    lock_guard<mutex> lock(statsMutex);
+
+    blockSizeCounts[blockSize]++;
+    this->horBlockCount += horBlockCount;
+    this->verBlockCount += verBlockCount;
+}
+
+void CodecStats::setTotal(double seconds, uint64_t outSize)
+{
+    lock_guard<mutex> lock(statsMutex);
+
+    uint64_t inSize = 0;
+    for (const StageStats &stage : stages)
+    {
+        if (stage.name == "read") {
+            inSize = stage.inSize;
+        }
+    }
+    total = {"total", seconds, inSize, outSize};
+}
+
+void CodecStats::print(ostream &os) const
+{
+    os << fixed << setprecision(3);
+    os << left << setw(20) << "stage" << right << setw(12) << "time [ms]" << setw(14) << "in [B]"
+       << setw(14) << "out [B]" << setw(14) << "speed [MB/s]" << "\n";
+    for (const StageStats &stage : stages) {
+        printStage(os, stage);
+    }
+    printStage(os, total);
+
+    if (huffUsed)
+    {
+        os << "Huffman coding: " << huffStats.symbolCount << " symbols, average code length "
+           << getRatio(huffStats.codeBitCount, huffStats.symbolCount) << " bits, maximum depth "
+           << huffStats.maxDepth << "\n";
+    }
+    if (huffStats.escapeCount > 0) // only adaptive trees have NYT node
+    {
+        os << "Huffman tree: " << getRatio(huffStats.swapCount, huffStats.symbolCount)
+           << " swaps per symbol, " << huffStats.escapeCount << " NYT escapes";
+        if (huffStats.cacheLookups > 0) { // encoding only
+            os << ", code cache hit rate "
+               << 100 * getRatio(huffStats.cacheHits, huffStats.cacheLookups) << " %";
+        }
+        os << "\n";
+    }
+
+    if (!blockSizeCounts.empty())
+    {
+        os << "adaptive block RLE: block size";
+        for (const auto &blockSizeCount : blockSizeCounts) {
+            os << " " << blockSizeCount.first << " (" << blockSizeCount.second << "x)";
+        }
+        os << ", horizontal/vertical blocks " << horBlockCount << "/" << verBlockCount
+           << " (" << getRatio(horBlockCount, verBlockCount) << ")\n";
+    }
+}
+
+void CodecStats::printJSON(ostream &os) const
+{
+    os << fixed << setprecision(6);
+    os << "{\"stages\": [";
+    for (uint64_t i = 0; i < stages.size(); i++)
+    {
+        os << (i > 0 ? ", " : "");
+        printStageJSON(os, stages[i]);
+    }
+    os << "], \"total\": ";
+    printStageJSON(os, total);
+
+    if (huffUsed)
+    {
+        os << ", \"huffman\": {\"symbols\": " << huffStats.symbolCount
+           << ", \"avg_code_length\": " << getRatio(huffStats.codeBitCount, huffStats.symbolCount)
+           << ", \"max_depth\": " << huffStats.maxDepth
+           << ", \"swaps_per_symbol\": " << getRatio(huffStats.swapCount, huffStats.symbolCount)
+           << ", \"nyt_escapes\": " << huffStats.escapeCount;
+        if (huffStats.cacheLookups > 0) {
+            os << ", \"code_cache_hit_rate\": "
+               << getRatio(huffStats.cacheHits, huffStats.cacheLookups);
+        }
+        os << "}";
+    }
+
+    if (!blockSizeCounts.empty())
+    {
+        os << ", \"adaptive_rle\": {\"block_sizes\": {";
+        bool first = true;
+        for (const auto &blockSizeCount : blockSizeCounts)
+        {
+            os << (first ? "" : ", ") << "\"" << blockSizeCount.first << "\": "
+               << blockSizeCount.second;
+            first = false;
+        }
+        os << "}, \"horizontal_blocks\": " << horBlockCount
+           << ", \"vertical_blocks\": " << verBlockCount
+           << ", \"horizontal_vertical_ratio\": " << getRatio(horBlockCount, verBlockCount) << "}";
+    }
+    os << "}\n";
+}
+
+// -------------------------- STAGE TIMER --------------------------------------
+
+StageTimer::StageTimer(CodecStats *stats) : stats(stats)
+{
+    if (stats != nullptr) {
+        start = steady_clock::now();
+    }
+}
+
+void StageTimer::stop(const char *name, uint64_t inSize, uint64_t outSize)
+{
+    if (stats != nullptr)
+    {
+        duration<double> seconds = steady_clock::now() - start;
+        stats->addStage(name, seconds.count(), inSize, outSize);
+    }
+}
@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of statistics collected during compression and decompression.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+
+using std::string;
+using std::vector;
+using std::map;
+using std::mutex;
+using std::ostream;
+using std::chrono::steady_clock;
+
+
+// wall time and sizes of one stage of the pipeline
+struct StageStats
+{
+    string name;
+    double seconds;
+    uint64_t inSize;
+    uint64_t outSize;
+};
+
+// internals of Huffman coding (tree values are zero for static Huffman coding)
+struct HuffStats
+{
+    uint64_t symbolCount;
+    uint64_t codeBitCount; // bits of codes only (without escaped symbols and headers)
+    uint64_t maxDepth; // maximum depth of the tree (or the maximum code length)
+    uint64_t swapCount; // swaps of nodes when updating the tree
+    uint64_t escapeCount; // NYT escapes (first occurrences of symbols, in each context)
+    uint64_t cacheHits; // code cache (encoding only)
+    uint64_t cacheLookups;
+};
+
+// statistics collected during compression or decompression
+// they may be shared by chunks processed in parallel (values are summed up)
+class CodecStats
+{
+public:
+    // add wall time and sizes of given stage (summed with the same stage name)
+    void addStage(const string &name, double seconds, uint64_t inSize, uint64_t outSize);
+    // add internals of one Huffman coding
+    void addHuffStats(const HuffStats &stats);
+    // add result of one adaptive block RLE (the chosen block size and scan directions)
+    void addAdaptRLEStats(uint64_t blockSize, uint64_t horBlockCount, uint64_t verBlockCount);
+    // set wall time and output size of the whole operation (input size is the size
+    // of read data, so the read stage must be added first)
+    void setTotal(double seconds, uint64_t outSize);
+
+    // print human-readable statistics to given stream
+    void print(ostream &os) const;
+    // print statistics in JSON format to given stream
+    void printJSON(ostream &os) const;
+
+private:
+    mutex statsMutex;
+
+    vector<StageStats> stages; // in the order of the first occurrence
+    StageStats total = {"total", 0, 0, 0};
+
+    HuffStats huffStats = {};
+    bool huffUsed = false;
+
+    map<uint64_t, uint64_t> blockSizeCounts; // chosen block sizes (one for each chunk)
+    uint64_t horBlockCount = 0;
+    uint64_t verBlockCount = 0;
+};
+
+// measure wall time of one stage, nothing is measured without statistics
+class StageTimer
+{
+public:
+    // start measuring (statistics may be null)
+    StageTimer(CodecStats *stats);
+
+    // stop measuring and add given stage to statistics
+    void stop(const char *name, uint64_t inSize, uint64_t outSize);
+
+private:
+    CodecStats *stats;
+    steady_clock::time_point start;
+};
@@ -0,0 +1,143 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of a simple thread pool for parallel loops.
+//------------------------------------------------------------------------------
+
+#include "threadpool.hpp"
+
+using std::lock_guard;
+using std::unique_lock;
+using std::current_exception;
+using std::rethrow_exception;
+
+// set for threads running iterations of a loop (to detect nested loops)
+thread_local bool insideLoop = false;
+
+// -------------------------- PUBLIC -------------------------------------------
+
+ThreadPool::ThreadPool(unsigned int threadCount) :
+    job(nullptr), jobCount(0), nextIndex(0), doneCount(0),
+    jobFailed(false), jobException(nullptr), jobGeneration(0), activeWorkers(0), stopping(false)
+{
+    if (threadCount == 0) {
+        threadCount = thread::hardware_concurrency();
+    }
+
+    // the calling thread is counted too
+    for (unsigned int i = 1; i < threadCount; i++) {
+        workers.emplace_back(&ThreadPool::runWorker, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobStart.notify_all();
+
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(uint64_t count, const function<void(uint64_t)> &func)
+{
+    if (workers.empty() || count <= 1 || insideLoop)
+    {
+        for (uint64_t i = 0; i < count; i++) {
+            func(i);
+        }
+        return;
+    }
+
+    lock_guard<mutex> callLock(callMutex);
+    {
+        lock_guard<mutex> lock(jobMutex);
+        job = &func;
+        jobCount = count;
+        nextIndex = 0;
+        doneCount = 0;
+        jobFailed = false;
+        jobException = nullptr;
+        jobGeneration++;
+    }
+    jobStart.notify_all();
+
+    runJob(func, count); // help the workers
+
+    // wait for all iterations, and also for all workers to leave the job
+    unique_lock<mutex> lock(jobMutex);
+    jobDone.wait(lock, [this] { return doneCount == jobCount && activeWorkers == 0; });
+    job = nullptr;
+
+    if (jobException != nullptr) {
+        rethrow_exception(jobException);
+    }
+}
+
+unsigned int ThreadPool::getThreadCount() const {
+    return workers.size() + 1;
+}
+
+// -------------------------- PRIVATE ------------------------------------------
+
+void ThreadPool::runWorker()
+{
+    uint64_t seenGeneration = 0;
+
+    unique_lock<mutex> lock(jobMutex);
+    while (true)
+    {
+        jobStart.wait(lock, [this, seenGeneration] {
+            return stopping || (job != nullptr && jobGeneration != seenGeneration);
+        });
+        if (stopping) {
+            return;
+        }
+
+        // join the current job
+        seenGeneration = jobGeneration;
+        const function<void(uint64_t)> &func = *job;
+        uint64_t count = jobCount;
+        activeWorkers++;
+
+        lock.unlock();
+        runJob(func, count);
+        lock.lock();
+
+        activeWorkers--;
+        jobDone.notify_all();
+    }
+}
+
+void ThreadPool::runJob(const function<void(uint64_t)> &func, uint64_t count)
+{
+    insideLoop = true;
+
+    uint64_t i;
+    while ((i = nextIndex++) < count)
+    {
+        // iterations are still counted after a failure, so the loop may finish
+        if (!jobFailed)
+        {
+            try {
+                func(i);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(jobMutex);
+                if (!jobFailed) {
+                    jobException = current_exception();
+                }
+                jobFailed = true;
+            }
+        }
+        doneCount++;
+    }
+
+    insideLoop = false;
+}
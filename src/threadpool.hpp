@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of a simple thread pool for parallel loops.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+using std::vector;
+using std::thread;
+using std::mutex;
+using std::condition_variable;
+using std::atomic;
+using std::function;
+using std::exception_ptr;
+
+
+// pool of threads running iterations of parallel loops
+// the calling thread also runs iterations, so the pool with one thread has no workers
+class ThreadPool
+{
+public:
+    // create given number of threads (zero means the number of available cores)
+    ThreadPool(unsigned int threadCount = 0);
+    // wait for all worker threads to finish
+    ~ThreadPool();
+
+    // call given function for all indices from 0 to count - 1 and wait for them
+    // nested calls (from inside of the function) run in the calling thread only
+    // when the function throws, the remaining iterations are skipped and the first
+    // exception is rethrown in the calling thread
+    void parallelFor(uint64_t count, const function<void(uint64_t)> &func);
+
+    // return the number of threads (including the calling thread)
+    unsigned int getThreadCount() const;
+
+private:
+    vector<thread> workers;
+
+    mutex callMutex; // only one loop is running at a time
+    mutex jobMutex;
+    condition_variable jobStart;
+    condition_variable jobDone;
+
+    // current loop (job) shared by threads
+    const function<void(uint64_t)> *job;
+    uint64_t jobCount;
+    atomic<uint64_t> nextIndex;
+    atomic<uint64_t> doneCount;
+    atomic<bool> jobFailed; // remaining iterations are skipped
+    exception_ptr jobException; // the first exception thrown by the job
+    uint64_t jobGeneration; // incremented with each job
+    unsigned int activeWorkers; // workers running the current job
+    bool stopping;
+
+    // main function of worker threads
+    void runWorker();
+    // run iterations of the current job until there are none left
+    void runJob(const function<void(uint64_t)> &func, uint64_t count);
+};
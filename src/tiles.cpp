@@ -0,0 +1,233 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Implementation of functions working with tiled 2D data (rows of blocks of
+// adaptive block RLE coded independently).
+//------------------------------------------------------------------------------
+
+#include "tiles.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <tuple>
+
+#include "transform.hpp"
+#include "huffman.hpp"
+#include "headers.hpp"
+#include "error.hpp"
+
+using std::min;
+using std::count;
+using std::get;
+using std::tuple;
+
+// -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
+
+// return Huffman coding header of tiled stream of given sizes
+HuffHeader getTilesHeader(uint64_t byteCount, uint64_t rawSize, const CodecOptions &options)
+{
+    HuffHeader header;
+    header.byteCount = byteCount;
+    header.adaptRLEUsed = true;
+    header.vitterUsed = options.useVitter;
+    header.staticUsed = options.useStatic;
+    header.rawSizeStored = true;
+    header.rawSize = rawSize;
+    header.contextsUsed = options.useContexts;
+    header.rescalingUsed = !options.useStatic && byteCount >= MAX_ROOT_FREQ; // trees may be rescaled
+    header.tilesUsed = true;
+    return header;
+}
+
+// encode given RLE data of one row of blocks with Huffman coding to a new vector
+vector<uint8_t> compressRow(const vector<uint8_t> &rowData, const CodecOptions &options)
+{
+    vector<uint8_t> packedRow;
+    BitWriter bitWriter(packedRow);
+    if (options.useStatic) {
+        applyStaticHuffman(rowData, bitWriter, options.stats);
+    } else {
+        applyHuffman(rowData, options.useVitter, options.useContexts, bitWriter, options.stats);
+    }
+    return packedRow;
+}
+
+// decode given Huffman coded data of one row of blocks to RLE data of given size
+vector<uint8_t> decompressRow(
+    const uint8_t *packedRow,
+    uint64_t packedSize,
+    uint64_t byteCount,
+    const HuffHeader &header,
+    const CodecOptions &options)
+{
+    BitReader bitReader(packedRow, packedSize);
+    vector<uint8_t> rowData;
+    if (header.staticUsed) {
+        revertStaticHuffman(bitReader, byteCount, rowData, options.stats);
+    } else {
+        revertHuffman(bitReader, byteCount, header.vitterUsed, header.contextsUsed,
+            header.rescalingUsed, options.useDecodeTable, rowData, options.stats);
+    }
+    return rowData;
+}
+
+// -------------------------- TILES --------------------------------------------
+
+void compressTiles(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    vector<uint8_t> &outData)
+{
+    if ((size % options.matrixWidth) != 0) {
+        throw CodecError("invalid size of input 2D data detected", 6);
+    }
+    uint64_t matrixWidth = options.matrixWidth;
+    uint64_t matrixHeight = size / matrixWidth;
+
+    StageTimer rleTimer(options.stats);
+    tuple<vector<uint8_t>, uint64_t, vector<bool>, vector<uint64_t>> tiledTuple =
+        applyTiledAdaptRLE(data, matrixWidth, matrixHeight, threadPool, options.stats);
+    const vector<uint8_t> &rleData = get<0>(tiledTuple);
+    const vector<uint64_t> &rowIndices = get<3>(tiledTuple);
+    rleTimer.stop("adaptive block RLE", size, rleData.size());
+
+    // each row starts with new trees, so rows are coded in parallel
+    StageTimer huffTimer(options.stats);
+    uint64_t rowCount = rowIndices.size() - 1;
+    vector<vector<uint8_t>> packedRows(rowCount);
+    threadPool.parallelFor(rowCount, [&](uint64_t i)
+    {
+        packedRows[i] = compressRow(vector<uint8_t>(
+            rleData.begin() + rowIndices[i], rleData.begin() + rowIndices[i + 1]), options);
+    });
+
+    // rows are stored in order, so their offsets are known now
+    vector<TileRowOffsets> rowOffsets;
+    uint64_t packedOffset = 0;
+    for (uint64_t i = 0; i < rowCount; i++)
+    {
+        rowOffsets.push_back({rowIndices[i], packedOffset});
+        packedOffset += packedRows[i].size();
+    }
+    huffTimer.stop(options.useStatic ? "static Huffman" : "adaptive Huffman",
+        rleData.size(), packedOffset);
+
+    vector<uint8_t> huffHeader = createHuffHeader(getTilesHeader(rleData.size(), size, options));
+    outData.assign(huffHeader.begin(), huffHeader.end());
+    vector<uint8_t> rleHeader = createAdaptRLEHeader(matrixWidth, matrixHeight,
+        get<1>(tiledTuple), get<2>(tiledTuple), {}, rowOffsets);
+    outData.insert(outData.end(), rleHeader.begin(), rleHeader.end());
+    for (const vector<uint8_t> &packedRow : packedRows) {
+        outData.insert(outData.end(), packedRow.begin(), packedRow.end());
+    }
+}
+
+uint64_t decompressTiles(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    const OutputAllocator &allocOutput)
+{
+    HuffHeader header = extractHuffHeader(data, size);
+    uint64_t headerSize = getHuffHeaderSize(data, size);
+
+    // tiles are used only for 2D data with adaptive block RLE and nothing else
+    if (!header.adaptRLEUsed || !header.rawSizeStored || header.diffModelUsed ||
+        header.chunksUsed || header.predictorUsed || header.rowLengthsStored)
+    {
+        throw CodecError("invalid Huffman coding header", 8);
+    }
+
+    tuple<uint64_t, uint64_t, uint64_t, vector<bool>, vector<uint64_t>, vector<TileRowOffsets>, uint64_t>
+        adaptRLETuple = extractAdaptRLEHeader(data + headerSize, size - headerSize, false, true);
+    uint64_t matrixWidth = get<0>(adaptRLETuple);
+    uint64_t matrixHeight = get<1>(adaptRLETuple);
+    uint64_t blockSize = get<2>(adaptRLETuple);
+    const vector<bool> &scanDirs = get<3>(adaptRLETuple);
+    const vector<TileRowOffsets> &rowOffsets = get<5>(adaptRLETuple);
+    headerSize += get<6>(adaptRLETuple);
+
+    if (matrixWidth * matrixHeight != header.rawSize) {
+        throw CodecError("invalid size of decompressed data", 23);
+    }
+
+    // sizes are limited by the data like for a single stream (see decompressStream)
+    const uint8_t *packedData = data + headerSize;
+    uint64_t packedSize = size - headerSize;
+    if (header.byteCount > packedSize * CHAR_BIT) {
+        throw CodecError("invalid Huffman coding file contents", 9);
+    }
+    if (!header.staticUsed && !header.rescalingUsed && header.byteCount > UINT32_MAX) {
+        throw CodecError("invalid Huffman coding file contents", 9);
+    }
+    if (header.rawSize > header.byteCount * UINT8_MAX) {
+        throw CodecError("invalid size of decompressed data", 23);
+    }
+    if (rowOffsets.empty() || rowOffsets.back().dataOffset > header.byteCount ||
+        rowOffsets.back().packedOffset > packedSize)
+    {
+        throw CodecError("invalid adaptive block RLE header", 11);
+    }
+
+    if (options.stats != nullptr)
+    {
+        uint64_t horBlockCount = count(scanDirs.begin(), scanDirs.end(), true);
+        options.stats->addAdaptRLEStats(blockSize, horBlockCount, scanDirs.size() - horBlockCount);
+    }
+
+    // only rows of blocks covering the rectangle are decoded (to a temporary buffer)
+    uint64_t rowCount = rowOffsets.size();
+    uint64_t firstRow = 0;
+    uint64_t endRow = rowCount;
+    if (options.usesRect())
+    {
+        checkRect(options, matrixWidth, matrixHeight);
+        firstRow = options.rectY / blockSize;
+        endRow = (options.rectY + options.rectHeight - 1) / blockSize + 1;
+    }
+    uint64_t firstLine = firstRow * blockSize;
+    uint64_t lineCount = min(endRow * blockSize, matrixHeight) - firstLine;
+
+    vector<uint8_t> rowLines;
+    uint8_t *outData;
+    if (options.usesRect())
+    {
+        rowLines.resize(lineCount * matrixWidth);
+        outData = rowLines.data();
+    } else {
+        outData = allocOutput(header.rawSize);
+    }
+
+    threadPool.parallelFor(endRow - firstRow, [&](uint64_t i)
+    {
+        uint64_t row = firstRow + i;
+        TileRowOffsets offsets = rowOffsets[row];
+        TileRowOffsets endOffsets = row + 1 < rowCount ?
+            rowOffsets[row + 1] : TileRowOffsets{header.byteCount, packedSize};
+        uint64_t rowSize = (min((row + 1) * blockSize, matrixHeight) - row * blockSize) * matrixWidth;
+
+        StageTimer huffTimer(options.stats);
+        vector<uint8_t> rowData = decompressRow(
+            packedData + offsets.packedOffset, endOffsets.packedOffset - offsets.packedOffset,
+            endOffsets.dataOffset - offsets.dataOffset, header, options);
+        huffTimer.stop(header.staticUsed ? "static Huffman" : "adaptive Huffman",
+            endOffsets.packedOffset - offsets.packedOffset, rowData.size());
+
+        StageTimer rleTimer(options.stats);
+        revertAdaptRLERow(rowData.data(), rowData.size(), matrixWidth, matrixHeight,
+            blockSize, scanDirs, row, outData + (row * blockSize - firstLine) * matrixWidth);
+        rleTimer.stop("adaptive block RLE", rowData.size(), rowSize);
+    });
+
+    if (!options.usesRect()) {
+        return header.rawSize;
+    }
+
+    uint64_t rectSize = options.rectWidth * options.rectHeight;
+    copyRect(options, rowLines.data(), matrixWidth, firstLine, allocOutput(rectSize));
+    return rectSize;
+}
@@ -0,0 +1,40 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file of functions working with tiled 2D data (rows of blocks of
+// adaptive block RLE coded independently).
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "codec.hpp"
+#include "threadpool.hpp"
+
+using std::vector;
+
+
+// compress given 2D data with adaptive block RLE as a single tiled stream, each row
+// of blocks is then coded by its own Huffman coding (rows are coded in parallel),
+// so any rows may be decompressed without the preceding ones
+// output parts: <Huffman-header><adaptive-RLE-header>{<row-data>}
+// the header of adaptive RLE is not Huffman coded, it contains offsets of rows
+// compressed data replace the contents of given vector (its capacity is reused)
+void compressTiles(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    vector<uint8_t> &outData);
+// decompress given tiled stream (rows are decompressed in parallel) straight to the
+// target from given allocator, it returns the size of decompressed data
+// for a rectangle of 2D data, only rows of blocks covering it are decompressed
+uint64_t decompressTiles(
+    const uint8_t *data,
+    uint64_t size,
+    const CodecOptions &options,
+    ThreadPool &threadPool,
+    const OutputAllocator &allocOutput);
@@ -7,17 +7,31 @@
 
 #include "transform.hpp"
 
-#include <iostream>
 #include <climits>
 #include <utility>
 #include <tuple>
+#include <algorithm>
+#include <cstring>
+#include <memory>
 
 #include "huffman.hpp"
+#include "vitter.hpp"
+#include "canonical.hpp"
 #include "headers.hpp"
+#include "simd.hpp"
+#include "error.hpp"
 
-using std::cerr;
 using std::get;
 using std::swap;
+using std::upper_bound;
+using std::min;
+using std::memset;
+using std::count;
+using std::max_element;
+using std::max;
+using std::unique_ptr;
+using std::make_tuple;
+using std::move;
 
 // -------------------------- HIDDEN HELPER FUNCTIONS ------------------------------
 
@@ -61,348 +75,870 @@ uint64_t getBlockSizeY(
     return blockSizeY;
 }
 
-// return vector of items in the given block with selected scan direction
-// we give block index -> it returns vector of its items
-vector<uint8_t> getBlockVector(
-    const vector<uint8_t> &matrix,
+// run RLE (MNP-5 Microcom format) over items of the given block in selected scan
+// direction, reading them from the matrix in place (see applyRLE)
+// each output byte is passed to given function, so it may be only counted
+template <typename OutFunc>
+void scanRLEBlock(
+    const uint8_t *matrix,
     uint64_t matrixWidth,
-    uint64_t matrixHeight,
-    uint64_t blockSize,
-    uint64_t blockIndex,
+    uint64_t blockBase,
+    uint64_t blockSizeX,
+    uint64_t blockSizeY,
+    bool horScan,
+    OutFunc out)
+{
+    // lines are rows for horizontal scan, columns for vertical scan
+    uint64_t lineCount = horScan ? blockSizeY : blockSizeX;
+    uint64_t lineSize = horScan ? blockSizeX : blockSizeY;
+    uint64_t lineStride = horScan ? matrixWidth : 1;
+    uint64_t itemStride = horScan ? 1 : matrixWidth;
+
+    uint8_t matchByte = 0;
+    int matchCount = 0;
+    for (uint64_t line = 0; line < lineCount; line++)
+    {
+        const uint8_t *lineData = matrix + blockBase + line * lineStride;
+        bool lastLine = line + 1 == lineCount;
+        for (uint64_t i = 0; i < lineSize; i++)
+        {
+            uint8_t curByte = lineData[i * itemStride];
+
+            // exclude the first (or reset) and last iteration from matching
+            if (curByte == matchByte && matchCount != 0 && !(lastLine && i + 1 == lineSize))
+            {
+                matchCount++;
+
+                if (matchCount <= 3) {
+                    out(curByte);
+                }
+                else if (matchCount == 258) // 255 + 3
+                {
+                    out(255);
+                    matchCount = 0; // reset
+                }
+            }
+            else
+            {
+                if (matchCount >= 3) {
+                    // preceding three characters are encoded directly
+                    out(matchCount - 3);
+                }
+
+                out(curByte);
+                matchByte = curByte;
+                matchCount = 1;
+            }
+        }
+    }
+}
+
+// return the size of the given block encoded with RLE in selected scan direction
+uint64_t getRLEBlockSize(
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t blockBase,
+    uint64_t blockSizeX,
+    uint64_t blockSizeY,
+    bool horScan)
+{
+    uint64_t size = 0;
+    scanRLEBlock(matrix, matrixWidth, blockBase, blockSizeX, blockSizeY, horScan,
+        [&size](uint8_t) { size++; });
+    return size;
+}
+
+// encode the given block with RLE in selected scan direction to given target
+void applyRLEBlock(
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t blockBase,
+    uint64_t blockSizeX,
+    uint64_t blockSizeY,
+    bool horScan,
+    uint8_t *tarData)
+{
+    scanRLEBlock(matrix, matrixWidth, blockBase, blockSizeX, blockSizeY, horScan,
+        [&tarData](uint8_t outByte) { *tarData++ = outByte; });
+}
+
+// decode RLE data (MNP-5 Microcom format) from given index to given target, until
+// the target is full or all data are read (the index is moved accordingly)
+// it returns false when the decoded bytes would not fit to the target
+bool revertRLEData(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t &index,
+    uint8_t *tarData,
+    uint64_t tarSize)
+{
+    uint64_t tarIndex = 0;
+    uint8_t matchByte = 0;
+    int matchCount = 0;
+    while (tarIndex < tarSize && index < size)
+    {
+        uint8_t curByte = data[index++];
+
+        if (matchCount == 3)
+        {
+            // unroll the encoded number of bytes at once
+            if (curByte > tarSize - tarIndex) {
+                return false;
+            }
+            memset(tarData + tarIndex, matchByte, curByte);
+            tarIndex += curByte;
+            matchCount = 0;
+        }
+        else
+        {
+            tarData[tarIndex++] = curByte;
+
+            if (matchByte == curByte) {
+                matchCount++;
+            } else
+            {
+                matchByte = curByte;
+                matchCount = 1;
+            }
+        }
+    }
+
+    return tarIndex == tarSize;
+}
+
+// insert given block vector to given target matrix vector based on given arguments
+// we give block base address -> it inserts the block to the given matrix
+void insertBlockVector(
+    uint8_t *matrix,
+    const uint8_t *blockVec,
+    uint64_t matrixWidth,
+    uint64_t blockBase,
+    uint64_t blockSizeX,
+    uint64_t blockSizeY,
     bool horScan)
 {
-    // compute block base address
-    uint64_t blockBase = getBlockBase(matrixWidth, blockSize, blockIndex);
-    uint64_t blockSizeX = getBlockSizeX(matrixWidth, blockBase, blockSize);
-    uint64_t blockSizeY = getBlockSizeY(matrixWidth, matrixHeight, blockBase, blockSize);
-    
     if (!horScan) {
         swap(blockSizeX, blockSizeY);
     }
 
-    vector<uint8_t> blockVec;
+    uint64_t blockVecIndex = 0;
     for (uint64_t y = 0; y < blockSizeY; y++) {
         for (uint64_t x = 0; x < blockSizeX; x++) {
             uint64_t xIndex = horScan ? x : y;
             uint64_t yIndex = horScan ? y : x;
 
-            blockVec.push_back(matrix[blockBase + (yIndex * matrixWidth) + xIndex]);
+            // current matrix vector address
+            uint64_t tarVecAddr = blockBase + (yIndex * matrixWidth) + xIndex;
+            matrix[tarVecAddr] = blockVec[blockVecIndex];
+            blockVecIndex++;
         }
     }
+}
 
-    return blockVec;
+// return the number of bytes of given value stored as varint (7 bits per byte)
+uint64_t getVarintSize(uint64_t value)
+{
+    uint64_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
 }
 
-// apply adaptive block RLE based on given arguments (also creates its header)
-vector<uint8_t> applyAdaptRLE(
-    const vector<uint8_t> &matrix,
+// find the best block size of adaptive block RLE for given matrix, all block sizes
+// and scan directions of blocks are tried in parallel (stored lengths or offsets of
+// rows of blocks are counted too), the chosen one is added to statistics
+// it returns a tuple of:
+//   * block size
+//   * scan direction of each block (horizontal - 1, vertical - 0)
+//   * index of encoded data of each block (the last item is their total size)
+tuple<uint64_t, vector<uint8_t>, vector<uint64_t>> findAdaptRLEBlocks(
+    const uint8_t *matrix,
     uint64_t matrixWidth,
     uint64_t matrixHeight,
-    uint64_t blockSize)
+    bool tilesUsed,
+    bool rowLengthsStored,
+    ThreadPool &threadPool,
+    CodecStats *stats)
 {
-    vector<bool> scanDirs; // scan directions
-    vector<uint8_t> blockData;
+    uint64_t curBlockSize = INIT_RLE_BLOCK_SIZE;
+    if (matrixWidth < curBlockSize || matrixHeight < curBlockSize) {
+        throw CodecError("too small 2D data dimensions", 12);
+    }
 
-    uint64_t blockCount = getBlockCount(matrixWidth, matrixHeight, blockSize);
-    vector<uint8_t> horVec, verVec; // horizontal, vertical order
-    for (uint64_t i = 0; i < blockCount; i++)
+    // we will find the most optimal block size, so try all of them
+    vector<uint64_t> blockSizes = {curBlockSize};
+    curBlockSize *= 2;
+    int doublingSteps = 1; // number of doubling block size
+    while (doublingSteps <= MAX_RLE_DOUBLING_STEPS &&
+           curBlockSize <= matrixWidth && curBlockSize <= matrixHeight)
     {
-        horVec = applyRLE(getBlockVector(matrix, matrixWidth, matrixHeight, blockSize, i, true));
-        verVec = applyRLE(getBlockVector(matrix, matrixWidth, matrixHeight, blockSize, i, false));
+        blockSizes.push_back(curBlockSize);
+        curBlockSize *= 2;
+        doublingSteps++;
+    }
+
+    // blocks of all block sizes are independent, so they are estimated at once
+    // (the first block of each block size is indexed, the last item is the total)
+    vector<uint64_t> firstBlocks = {0};
+    for (uint64_t blockSize : blockSizes) {
+        firstBlocks.push_back(
+            firstBlocks.back() + getBlockCount(matrixWidth, matrixHeight, blockSize));
+    }
+
+    // only sizes of encoded blocks are computed, no data are created yet
+    vector<uint64_t> blockDataSizes(firstBlocks.back());
+    vector<uint8_t> scanDirs(firstBlocks.back()); // not bits, written concurrently
+    threadPool.parallelFor(firstBlocks.back(), [&](uint64_t i)
+    {
+        uint64_t sizeIndex =
+            upper_bound(firstBlocks.begin(), firstBlocks.end(), i) - firstBlocks.begin() - 1;
+        uint64_t blockSize = blockSizes[sizeIndex];
+        uint64_t blockBase = getBlockBase(matrixWidth, blockSize, i - firstBlocks[sizeIndex]);
+        uint64_t blockSizeX = getBlockSizeX(matrixWidth, blockBase, blockSize);
+        uint64_t blockSizeY = getBlockSizeY(matrixWidth, matrixHeight, blockBase, blockSize);
+
+        uint64_t horSize = getRLEBlockSize(
+            matrix, matrixWidth, blockBase, blockSizeX, blockSizeY, true);
+        uint64_t verSize = getRLEBlockSize(
+            matrix, matrixWidth, blockBase, blockSizeX, blockSizeY, false);
 
         // check which scan direction is better
-        if (horVec.size() <= verVec.size())
+        scanDirs[i] = horSize <= verSize;
+        blockDataSizes[i] = scanDirs[i] ? horSize : verSize;
+    });
+
+    // the smallest block size wins when results have the same size
+    uint64_t bestIndex = 0;
+    uint64_t bestSize = UINT64_MAX;
+    for (uint64_t i = 0; i < blockSizes.size(); i++)
+    {
+        uint64_t blockCount = firstBlocks[i + 1] - firstBlocks[i];
+        uint64_t rowCount = getBlockRowCount(matrixHeight, blockSizes[i]);
+        uint64_t blocksInRow = blockCount / rowCount;
+        uint64_t curSize = 3 * sizeof(uint64_t) + (blockCount + CHAR_BIT - 1) / CHAR_BIT;
+        if (tilesUsed) {
+            curSize += rowCount * 2 * sizeof(uint64_t);
+        }
+        for (uint64_t j = 0; j < rowCount; j++)
         {
-            scanDirs.push_back(1);
-            blockData.insert(blockData.end(), horVec.begin(), horVec.end());
+            uint64_t rowSize = 0;
+            for (uint64_t k = 0; k < blocksInRow; k++) {
+                rowSize += blockDataSizes[firstBlocks[i] + j * blocksInRow + k];
+            }
+            curSize += rowSize;
+            if (rowLengthsStored) {
+                curSize += getVarintSize(rowSize);
+            }
         }
-        else
+
+        if (curSize < bestSize)
         {
-            scanDirs.push_back(0);
-            blockData.insert(blockData.end(), verVec.begin(), verVec.end());
+            bestIndex = i;
+            bestSize = curSize;
         }
     }
 
-    // first create header for adaptive RLE
-    vector<uint8_t> finalVec = createAdaptRLEHeader(
-        matrixWidth, matrixHeight, blockSize, scanDirs);
-    
-    // then append block data
-    finalVec.insert(finalVec.end(), blockData.begin(), blockData.end());
+    // the result contains the best block size only
+    uint64_t blockSize = blockSizes[bestIndex];
+    uint64_t firstBlock = firstBlocks[bestIndex];
+    uint64_t blockCount = firstBlocks[bestIndex + 1] - firstBlock;
+    vector<uint8_t> bestScanDirs(
+        scanDirs.begin() + firstBlock, scanDirs.begin() + firstBlock + blockCount);
+
+    if (stats != nullptr)
+    {
+        uint64_t horBlockCount = count(bestScanDirs.begin(), bestScanDirs.end(), true);
+        stats->addAdaptRLEStats(blockSize, horBlockCount, blockCount - horBlockCount);
+    }
 
-    return finalVec;
+    // positions of block data are known, so they may be encoded in parallel
+    vector<uint64_t> blockIndices(blockCount + 1);
+    for (uint64_t i = 0; i < blockCount; i++) {
+        blockIndices[i + 1] = blockIndices[i] + blockDataSizes[firstBlock + i];
+    }
+
+    return make_tuple(blockSize, bestScanDirs, blockIndices);
 }
 
-// perform one step of decoding RLE, appending the result to target vector
-void revertRLEStep(vector<uint8_t> &tarVec, uint8_t &matchByte, int &matchCount, uint8_t curByte)
+// encode all blocks of adaptive block RLE to given target in parallel, the blocks
+// are given by the result of the function above
+void encodeAdaptRLEBlocks(
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    uint64_t blockSize,
+    const vector<uint8_t> &scanDirs,
+    const vector<uint64_t> &blockIndices,
+    uint8_t *tarData,
+    ThreadPool &threadPool)
 {
-    if (matchCount == 3)
+    threadPool.parallelFor(scanDirs.size(), [&](uint64_t i)
     {
-        // unroll the encoded number of bytes
-        for (int i = 0; i < curByte; i++) {
-            tarVec.push_back(matchByte);
+        uint64_t blockBase = getBlockBase(matrixWidth, blockSize, i);
+        uint64_t blockSizeX = getBlockSizeX(matrixWidth, blockBase, blockSize);
+        uint64_t blockSizeY = getBlockSizeY(matrixWidth, matrixHeight, blockBase, blockSize);
+        applyRLEBlock(matrix, matrixWidth, blockBase, blockSizeX, blockSizeY,
+            scanDirs[i], tarData + blockIndices[i]);
+    });
+}
+
+// decode blocks of adaptive block RLE from the first given block up to the end one,
+// reading their data from given index (it is moved accordingly)
+// the output holds whole lines of 2D data starting at given line
+void revertAdaptRLEBlocks(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t &index,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    uint64_t blockSize,
+    const vector<bool> &scanDirs,
+    uint64_t firstBlock,
+    uint64_t endBlock,
+    uint8_t *outData,
+    uint64_t firstLine)
+{
+    uint64_t outBase = firstLine * matrixWidth;
+
+    // one block buffer of each thread is reused for all blocks (and calls)
+    thread_local vector<uint8_t> curBlock;
+    curBlock.resize(min(blockSize, matrixWidth) * min(blockSize, matrixHeight));
+    for (uint64_t i = firstBlock; i < endBlock; i++)
+    {
+        uint64_t blockBase = getBlockBase(matrixWidth, blockSize, i);
+        uint64_t blockSizeX = getBlockSizeX(matrixWidth, blockBase, blockSize);
+        uint64_t blockSizeY = getBlockSizeY(matrixWidth, matrixHeight, blockBase, blockSize);
+
+        // extract and decode one block (boundaries checks included)
+        if (!revertRLEData(data, size, index, curBlock.data(), blockSizeX * blockSizeY))
+        {
+            if (index == size) {
+                throw CodecError("unexpected end of adaptive block RLE data", 14);
+            }
+            throw CodecError("invalid adaptive block RLE file contents", 13);
         }
-        matchCount = 0;
+        insertBlockVector(outData, curBlock.data(),
+            matrixWidth, blockBase - outBase, blockSizeX, blockSizeY, scanDirs[i]);
     }
-    else
+}
+
+// return statistics of given adaptive Huffman tree after coding of given symbols
+// to given number of bits (escaped symbols included)
+HuffStats getAdaptHuffStats(const AdaptHuffTree &tree, uint64_t symbolCount, uint64_t bitCount)
+{
+    uint64_t escapeCount = tree.getEscapeCount();
+    return {symbolCount, bitCount - escapeCount * BITS_IN_SYMBOL, tree.getMaxDepth(),
+            tree.getSwapCount(), escapeCount, tree.getCodeCacheHits(), tree.getCodeCacheLookups()};
+}
+
+// return statistics of given static Huffman code after coding of given symbols
+// to given number of bits (the code is not changing, so only its depth is known)
+HuffStats getStaticHuffStats(const CanonHuffCode &code, uint64_t symbolCount, uint64_t bitCount)
+{
+    const uint8_t *codeLengths = code.getCodeLengths();
+    uint64_t maxDepth = *max_element(codeLengths, codeLengths + MAX_SYMBOLS);
+    return {symbolCount, bitCount, maxDepth, 0, 0, 0, 0};
+}
+
+// encode given data using adaptive Huffman tree of given type
+template <typename Tree>
+void applyAdaptHuffman(const vector<uint8_t> &vec, BitWriter &writer, CodecStats *stats)
+{
+    Tree huffTree; // call default contructor
+    uint64_t firstBit = writer.getBitCount();
+
+    // encode input data to the bit stream
+    for (uint8_t symbol : vec)
+    {
+        huffTree.encode(symbol, writer);
+        huffTree.update(symbol);
+    }
+
+    if (stats != nullptr) {
+        stats->addHuffStats(
+            getAdaptHuffStats(huffTree, vec.size(), writer.getBitCount() - firstBit));
+    }
+
+    // add remaining bits so their final count is divisible by bits in symbol
+    writer.flush();
+}
+
+// decode given bits using adaptive Huffman tree of given type
+template <typename Tree>
+void revertAdaptHuffman(
+    BitReader &reader,
+    uint64_t byteCount,
+    bool useRescaling,
+    bool useDecodeTable,
+    vector<uint8_t> &outVec,
+    CodecStats *stats)
+{
+    Tree huffTree; // call default contructor
+    huffTree.setRescaling(useRescaling);
+    huffTree.setDecodeTable(useDecodeTable);
+    uint64_t remainBitCount = reader.getRemainBitCount();
+
+    outVec.resize(byteCount); // all bytes are overwritten
+    for (uint64_t i = 0; i < byteCount; i++)
     {
-        tarVec.push_back(curByte);
+        int decResult = huffTree.decode(reader);
+        if (decResult == -1) {
+            throw CodecError("invalid Huffman coding file contents", 9);
+        }
+        uint8_t symbol = decResult;
+    
+        huffTree.update(symbol);
+        outVec[i] = symbol;
+    }
+
+    if (stats != nullptr) {
+        stats->addHuffStats(getAdaptHuffStats(
+            huffTree, byteCount, remainBitCount - reader.getRemainBitCount()));
+    }
+}
 
-        if (matchByte == curByte) {
-            matchCount++;
-        } else
+// return statistics of given bank of context trees and their escape tree after
+// coding of given symbols to given number of bits (NYT escapes of all trees are
+// counted, but only the escape tree has raw escapes, which are not code bits)
+template <typename Tree>
+HuffStats getContextHuffStats(
+    const vector<unique_ptr<Tree>> &contextTrees,
+    const AdaptHuffTree &escapeTree,
+    uint64_t symbolCount,
+    uint64_t bitCount)
+{
+    HuffStats huffStats = getAdaptHuffStats(escapeTree, symbolCount, bitCount);
+    for (const unique_ptr<Tree> &tree : contextTrees)
+    {
+        if (tree != nullptr)
         {
-            matchByte = curByte;
-            matchCount = 1;
+            huffStats.maxDepth = max(huffStats.maxDepth, uint64_t(tree->getMaxDepth()));
+            huffStats.swapCount += tree->getSwapCount();
+            huffStats.escapeCount += tree->getEscapeCount();
+            huffStats.cacheHits += tree->getCodeCacheHits();
+            huffStats.cacheLookups += tree->getCodeCacheLookups();
         }
     }
+    return huffStats;
 }
 
-// extract and decode one block encoded in RLE (boundaries checks included)
-vector<uint8_t> revertRLEBlock(deque<uint8_t> &deq, uint64_t reqResultSize)
+// encode given data using order-1 context modelling, there is one adaptive tree of
+// given type for each bucket of previous symbols (created on its first use)
+// symbols new in their context are escaped by NYT code of the context tree and then
+// coded by a shared order-0 tree, which sends raw symbols only when seen first time
+template <typename Tree>
+void applyContextHuffman(const vector<uint8_t> &vec, BitWriter &writer, CodecStats *stats)
 {
-    vector<uint8_t> finalVec; // new vector
+    vector<unique_ptr<Tree>> contextTrees(MAX_SYMBOLS >> CONTEXT_SHIFT);
+    Tree escapeTree;
+    uint64_t firstBit = writer.getBitCount();
 
-    uint8_t matchByte = 0;
-    int matchCount = 0;
-    while (finalVec.size() < reqResultSize)
+    uint8_t context = 0; // the first symbol has no predecessor
+    for (uint8_t symbol : vec)
     {
-        if (deq.empty())
+        if (contextTrees[context] == nullptr)
         {
-            cerr << "ERROR: unexpected end of adaptive block RLE data\n";
-            exit(14);
+            contextTrees[context].reset(new Tree());
+            contextTrees[context]->setRawEscapes(false);
         }
+        Tree &huffTree = *contextTrees[context];
 
-        uint8_t curByte = deq.front(); deq.pop_front(); // extract
-        revertRLEStep(finalVec, matchByte, matchCount, curByte); // decode
+        if (!huffTree.hasSymbol(symbol)) // NYT code, then the symbol from escape tree
+        {
+            huffTree.encode(symbol, writer);
+            escapeTree.encode(symbol, writer);
+            escapeTree.update(symbol);
+        }
+        else {
+            huffTree.encode(symbol, writer);
+        }
+        huffTree.update(symbol);
+        context = symbol >> CONTEXT_SHIFT;
     }
 
-    if (finalVec.size() != reqResultSize)
-    {
-        cerr << "ERROR: invalid adaptive block RLE file contents\n";
-        exit(13);
+    if (stats != nullptr) {
+        stats->addHuffStats(getContextHuffStats(
+            contextTrees, escapeTree, vec.size(), writer.getBitCount() - firstBit));
     }
 
-    return finalVec;
+    // add remaining bits so their final count is divisible by bits in symbol
+    writer.flush();
 }
 
-// insert given block vector to given target matrix vector based on given arguments
-// we give block base address -> it inserts the block to the given matrix
-void insertBlockVector(
-    vector<uint8_t> &matrix,
-    const vector<uint8_t> &blockVec,
-    uint64_t matrixWidth,
-    uint64_t blockBase,
-    uint64_t blockSizeX,
-    uint64_t blockSizeY,
-    bool horScan)
+// decode given bits using order-1 context modelling (see the encoding above)
+template <typename Tree>
+void revertContextHuffman(
+    BitReader &reader,
+    uint64_t byteCount,
+    bool useRescaling,
+    bool useDecodeTable,
+    vector<uint8_t> &outVec,
+    CodecStats *stats)
 {
-    if (!horScan) {
-        swap(blockSizeX, blockSizeY);
-    }
-
-    uint64_t blockVecIndex = 0;
-    for (uint64_t y = 0; y < blockSizeY; y++) {
-        for (uint64_t x = 0; x < blockSizeX; x++) {
-            uint64_t xIndex = horScan ? x : y;
-            uint64_t yIndex = horScan ? y : x;
+    vector<unique_ptr<Tree>> contextTrees(MAX_SYMBOLS >> CONTEXT_SHIFT);
+    Tree escapeTree;
+    escapeTree.setRescaling(useRescaling);
+    escapeTree.setDecodeTable(useDecodeTable);
+    uint64_t remainBitCount = reader.getRemainBitCount();
+
+    outVec.resize(byteCount); // all bytes are overwritten
+    uint8_t context = 0;
+    for (uint64_t i = 0; i < byteCount; i++)
+    {
+        if (contextTrees[context] == nullptr)
+        {
+            contextTrees[context].reset(new Tree());
+            contextTrees[context]->setRawEscapes(false);
+            contextTrees[context]->setRescaling(useRescaling);
+            contextTrees[context]->setDecodeTable(useDecodeTable);
+        }
+        Tree &huffTree = *contextTrees[context];
 
-            // current matrix vector address
-            uint64_t tarVecAddr = blockBase + (yIndex * matrixWidth) + xIndex;
-            matrix[tarVecAddr] = blockVec[blockVecIndex];
-            blockVecIndex++;
+        int decResult = huffTree.decode(reader);
+        if (decResult == NYT_SYMBOL) // symbol is new in this context
+        {
+            decResult = escapeTree.decode(reader);
+            if (decResult != -1) {
+                escapeTree.update(decResult);
+            }
+        }
+        if (decResult == -1) {
+            throw CodecError("invalid Huffman coding file contents", 9);
         }
+        uint8_t symbol = decResult;
+
+        huffTree.update(symbol);
+        outVec[i] = symbol;
+        context = symbol >> CONTEXT_SHIFT;
+    }
+
+    if (stats != nullptr) {
+        stats->addHuffStats(getContextHuffStats(
+            contextTrees, escapeTree, byteCount, remainBitCount - reader.getRemainBitCount()));
     }
 }
 
 // -------------------------- TRANSFORMATION ---------------------------------
 
-void applyDiffModel(vector<uint8_t> &vec)
+void applyDiffModel(vector<uint8_t> &vec) {
+    applyDiffKernel(vec.data(), vec.size());
+}
+
+void revertDiffModel(uint8_t *data, uint64_t size) {
+    revertDiffKernel(data, size);
+}
+
+void applyRLE(const vector<uint8_t> &vec, vector<uint8_t> &outVec)
 {
-    uint8_t prevVal = 0;
-    for (uint8_t &vecItem : vec)
-    {
-        uint8_t curVal = vecItem;
-        vecItem = (curVal - prevVal); // truncated result of underflow
-        prevVal = curVal;
-    }
+    outVec.resize(vec.size() + vec.size() / 3 + 1); // the worst case
+    outVec.resize(applyRLEKernel(vec.data(), vec.size(), outVec.data()));
 }
 
-void revertDiffModel(vector<uint8_t> &vec)
+void revertRLE(const uint8_t *data, uint64_t size, uint8_t *outData, uint64_t outSize)
 {
-    uint8_t prevVal = 0;
-    for (uint8_t &vecItem : vec)
-    {
-        vecItem += prevVal; // may overflow (truncated)
-        prevVal = vecItem;
+    uint64_t index = 0;
+    if (!revertRLEData(data, size, index, outData, outSize) || index != size) {
+        throw CodecError("invalid size of decompressed data", 23);
     }
 }
 
-vector<uint8_t> applyRLE(const vector<uint8_t> &vec)
+uint64_t getRLERawSize(const uint8_t *data, uint64_t size)
 {
-    vector<uint8_t> finalVec; // new vector
-    
+    uint64_t rawSize = 0;
     uint8_t matchByte = 0;
     int matchCount = 0;
-    for (auto it = vec.begin(); it != vec.end(); ++it)
+    for (uint64_t i = 0; i < size; i++)
     {
-        uint8_t curByte = *it;
-
-        // exclude the first (or reset) and last iteration from matching
-        if (curByte == matchByte && matchCount != 0 && next(it) != vec.end())
+        uint8_t curByte = data[i];
+        if (matchCount == 3)
         {
-            matchCount++;
-
-            if (matchCount <= 3) {
-                finalVec.push_back(curByte);
-            }
-            else if (matchCount == 258) // 255 + 3
-            {
-                finalVec.push_back(255);
-                matchCount = 0; // reset
-            }
+            rawSize += curByte;
+            matchCount = 0;
         }
         else
         {
-            if (matchCount >= 3) {
-                // preceding three characters are encoded directly
-                finalVec.push_back(matchCount - 3);
-            }
+            rawSize++;
 
-            finalVec.push_back(curByte);
-            matchByte = curByte;
-            matchCount = 1;
+            if (matchByte == curByte) {
+                matchCount++;
+            } else
+            {
+                matchByte = curByte;
+                matchCount = 1;
+            }
         }
     }
 
-    return finalVec;
+    return rawSize;
 }
 
-vector<uint8_t> revertRLE(const deque<uint8_t> &deq)
+void applyAdaptRLE(
+    const vector<uint8_t> &matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    bool rowLengthsStored,
+    vector<uint8_t> &outVec,
+    ThreadPool &threadPool,
+    CodecStats *stats)
 {
-    vector<uint8_t> finalVec; // new vector
+    tuple<uint64_t, vector<uint8_t>, vector<uint64_t>> blocksTuple = findAdaptRLEBlocks(
+        matrix.data(), matrixWidth, matrixHeight, false, rowLengthsStored, threadPool, stats);
+    uint64_t blockSize = get<0>(blocksTuple);
+    const vector<uint8_t> &scanDirs = get<1>(blocksTuple);
+    const vector<uint64_t> &blockIndices = get<2>(blocksTuple);
+
+    // first create header for adaptive RLE (with lengths of rows of blocks if requested)
+    uint64_t rowCount = getBlockRowCount(matrixHeight, blockSize);
+    uint64_t blocksInRow = scanDirs.size() / rowCount;
+    vector<uint64_t> rowLengths;
+    for (uint64_t i = 0; rowLengthsStored && i < rowCount; i++) {
+        rowLengths.push_back(
+            blockIndices[(i + 1) * blocksInRow] - blockIndices[i * blocksInRow]);
+    }
+    vector<uint8_t> header = createAdaptRLEHeader(matrixWidth, matrixHeight, blockSize,
+        vector<bool>(scanDirs.begin(), scanDirs.end()), rowLengths);
+    outVec.assign(header.begin(), header.end());
+
+    // then block data
+    outVec.resize(header.size() + blockIndices.back());
+    encodeAdaptRLEBlocks(matrix.data(), matrixWidth, matrixHeight, blockSize,
+        scanDirs, blockIndices, outVec.data() + header.size(), threadPool);
+}
 
-    uint8_t matchByte = 0;
-    int matchCount = 0;
-    for (uint8_t curByte : deq) {
-        revertRLEStep(finalVec, matchByte, matchCount, curByte);
+tuple<vector<uint8_t>, uint64_t, vector<bool>, vector<uint64_t>> applyTiledAdaptRLE(
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    ThreadPool &threadPool,
+    CodecStats *stats)
+{
+    tuple<uint64_t, vector<uint8_t>, vector<uint64_t>> blocksTuple = findAdaptRLEBlocks(
+        matrix, matrixWidth, matrixHeight, true, false, threadPool, stats);
+    uint64_t blockSize = get<0>(blocksTuple);
+    const vector<uint8_t> &scanDirs = get<1>(blocksTuple);
+    const vector<uint64_t> &blockIndices = get<2>(blocksTuple);
+
+    vector<uint8_t> finalVec(blockIndices.back());
+    encodeAdaptRLEBlocks(matrix, matrixWidth, matrixHeight, blockSize,
+        scanDirs, blockIndices, finalVec.data(), threadPool);
+
+    // each row of blocks starts with its first block
+    uint64_t rowCount = getBlockRowCount(matrixHeight, blockSize);
+    uint64_t blocksInRow = (blockIndices.size() - 1) / rowCount;
+    vector<uint64_t> rowIndices;
+    for (uint64_t i = 0; i <= rowCount; i++) {
+        rowIndices.push_back(blockIndices[i * blocksInRow]);
     }
 
-    return finalVec;
+    return make_tuple(move(finalVec), blockSize,
+        vector<bool>(scanDirs.begin(), scanDirs.end()), rowIndices);
 }
 
-vector<uint8_t> applyAdaptRLE(
-    const vector<uint8_t> &matrix,
-    uint64_t matrixWidth,
-    uint64_t matrixHeight)
+void revertAdaptRLE(
+    const uint8_t *data,
+    uint64_t size,
+    uint8_t *outData,
+    uint64_t outSize,
+    bool rowLengthsStored,
+    ThreadPool &threadPool,
+    CodecStats *stats)
 {
-    uint64_t curBlockSize = INIT_RLE_BLOCK_SIZE;
-    if (matrixWidth < curBlockSize || matrixHeight < curBlockSize)
-    {
-        cerr << "ERROR: too small 2D data dimensions\n";
-        exit(12);
+    tuple<uint64_t, uint64_t, uint64_t, vector<bool>, vector<uint64_t>, vector<TileRowOffsets>, uint64_t>
+        adaptRLETuple = extractAdaptRLEHeader(data, size, rowLengthsStored);
+
+    uint64_t matrixWidth = get<0>(adaptRLETuple);
+    uint64_t matrixHeight = get<1>(adaptRLETuple);
+    uint64_t blockSize = get<2>(adaptRLETuple);
+    const vector<bool> &scanDirs = get<3>(adaptRLETuple);
+    const vector<uint64_t> &rowIndices = get<4>(adaptRLETuple);
+    uint64_t headerSize = get<6>(adaptRLETuple); // block data follow the header
+
+    if (matrixWidth * matrixHeight != outSize) {
+        throw CodecError("invalid size of decompressed data", 23);
     }
+    uint64_t blockCount = getBlockCount(matrixWidth, matrixHeight, blockSize);
 
-    // we will find the most optimal block size
-    vector<uint8_t> bestVec;
-    // first step before the loop
-    bestVec = applyAdaptRLE(matrix, matrixWidth, matrixHeight, curBlockSize);
+    if (stats != nullptr)
+    {
+        uint64_t horBlockCount = count(scanDirs.begin(), scanDirs.end(), true);
+        stats->addAdaptRLEStats(blockSize, horBlockCount, blockCount - horBlockCount);
+    }
 
-    curBlockSize *= 2;
-    int doublingSteps = 1; // number of doubling block size
-    vector<uint8_t> curVec;
-    while (doublingSteps <= MAX_RLE_DOUBLING_STEPS &&
-           curBlockSize <= matrixWidth && curBlockSize <= matrixHeight)
+    // small data (and older streams) have no lengths of rows, so blocks are decoded one by one
+    if (!rowLengthsStored)
     {
-        curVec = applyAdaptRLE(matrix, matrixWidth, matrixHeight, curBlockSize);
+        uint64_t index = headerSize;
+        revertAdaptRLEBlocks(data, size, index, matrixWidth, matrixHeight, blockSize,
+            scanDirs, 0, blockCount, outData, 0);
 
-        if (curVec.size() < bestVec.size()) {
-            bestVec = curVec;
+        if (index != size) {
+            throw CodecError("leftover data of adaptive block RLE detected", 15);
         }
+        return;
+    }
 
-        curBlockSize *= 2;
-        doublingSteps++;
+    // the lengths must cover exactly all block data
+    const uint8_t *blockData = data + headerSize;
+    uint64_t blockDataSize = size - headerSize;
+    if (rowIndices.back() > blockDataSize) {
+        throw CodecError("unexpected end of adaptive block RLE data", 14);
+    }
+    if (rowIndices.back() < blockDataSize) {
+        throw CodecError("leftover data of adaptive block RLE detected", 15);
     }
 
-    return bestVec;
+    // each row of blocks is located by its index, so rows are decoded in parallel
+    threadPool.parallelFor(rowIndices.size() - 1, [&](uint64_t i)
+    {
+        revertAdaptRLERow(blockData + rowIndices[i], rowIndices[i + 1] - rowIndices[i],
+            matrixWidth, matrixHeight, blockSize, scanDirs, i,
+            outData + i * blockSize * matrixWidth);
+    });
 }
 
-vector<uint8_t> revertAdaptRLE(deque<uint8_t> &deq)
+void revertAdaptRLERow(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    uint64_t blockSize,
+    const vector<bool> &scanDirs,
+    uint64_t row,
+    uint8_t *outData)
 {
-    tuple<uint64_t, uint64_t, uint64_t, vector<bool>> adaptRLETuple;
-    adaptRLETuple = extractAdaptRLEHeader(deq);
+    uint64_t blocksInRow = scanDirs.size() / getBlockRowCount(matrixHeight, blockSize);
 
-    uint64_t matrixWidth = get<0>(adaptRLETuple);
-    uint64_t matrixHeight = get<1>(adaptRLETuple);
-    uint64_t blockSize = get<2>(adaptRLETuple);
-    vector<bool> scanDirs = get<3>(adaptRLETuple);
+    uint64_t index = 0;
+    revertAdaptRLEBlocks(data, size, index, matrixWidth, matrixHeight, blockSize,
+        scanDirs, row * blocksInRow, (row + 1) * blocksInRow, outData, row * blockSize);
 
-    vector<uint8_t> finalMatrix(matrixWidth * matrixHeight);
-    uint64_t blockCount = getBlockCount(matrixWidth, matrixHeight, blockSize);
+    if (index != size) {
+        throw CodecError("leftover data of adaptive block RLE detected", 15);
+    }
+}
 
-    for (uint i = 0; i < blockCount; i++)
-    {
-        uint64_t blockBase = getBlockBase(matrixWidth, blockSize, i);
-        uint64_t blockSizeX = getBlockSizeX(matrixWidth, blockBase, blockSize);
-        uint64_t blockSizeY = getBlockSizeY(matrixWidth, matrixHeight, blockBase, blockSize);
+uint64_t getAdaptRLERawSize(const uint8_t *data, uint64_t size)
+{
+    if (size < 2 * sizeof(uint64_t)) {
+        throw CodecError("invalid or missing adaptive block RLE header", 10);
+    }
 
-        vector<uint8_t> curBlock = revertRLEBlock(deq, blockSizeX * blockSizeY);
-        insertBlockVector(
-            finalMatrix, curBlock, matrixWidth, blockBase, blockSizeX, blockSizeY, scanDirs[i]);
+    // the header starts with matrix width and height
+    uint64_t matrixWidth = 0;
+    uint64_t matrixHeight = 0;
+    for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+        matrixWidth = (matrixWidth << CHAR_BIT) | data[i];
+    }
+    for (unsigned int i = 0; i < sizeof(uint64_t); i++) {
+        matrixHeight = (matrixHeight << CHAR_BIT) | data[sizeof(uint64_t) + i];
     }
 
-    if (!deq.empty())
-    {
-        cerr << "ERROR: leftover data of adaptive block RLE detected\n";
-        exit(15);
+    return matrixWidth * matrixHeight;
+}
+
+void applyHuffman(
+    const vector<uint8_t> &vec,
+    bool useVitter,
+    bool useContexts,
+    BitWriter &writer,
+    CodecStats *stats)
+{
+    if (useContexts && useVitter) {
+        applyContextHuffman<VitterTree>(vec, writer, stats);
+    } else if (useContexts) {
+        applyContextHuffman<HuffTree>(vec, writer, stats); // FGK
+    } else if (useVitter) {
+        applyAdaptHuffman<VitterTree>(vec, writer, stats);
+    } else {
+        applyAdaptHuffman<HuffTree>(vec, writer, stats); // FGK
     }
+}
 
-    return finalMatrix;
+void revertHuffman(
+    BitReader &reader,
+    uint64_t byteCount,
+    bool useVitter,
+    bool useContexts,
+    bool useRescaling,
+    bool useDecodeTable,
+    vector<uint8_t> &outVec,
+    CodecStats *stats)
+{
+    if (useContexts && useVitter) {
+        revertContextHuffman<VitterTree>(
+            reader, byteCount, useRescaling, useDecodeTable, outVec, stats);
+    } else if (useContexts) {
+        revertContextHuffman<HuffTree>(
+            reader, byteCount, useRescaling, useDecodeTable, outVec, stats);
+    } else if (useVitter) {
+        revertAdaptHuffman<VitterTree>(
+            reader, byteCount, useRescaling, useDecodeTable, outVec, stats);
+    } else {
+        revertAdaptHuffman<HuffTree>( // FGK
+            reader, byteCount, useRescaling, useDecodeTable, outVec, stats);
+    }
 }
 
-vector<bool> applyHuffman(const vector<uint8_t> &vec)
+void applyStaticHuffman(const vector<uint8_t> &vec, BitWriter &writer, CodecStats *stats)
 {
-    // create the Huffman FGK tree
-    HuffTree huffTree; // call default contructor
+    // first pass to get frequencies of symbols
+    uint64_t symbolFreqs[MAX_SYMBOLS] = {};
+    for (uint8_t symbol : vec) {
+        symbolFreqs[symbol]++;
+    }
 
-    vector<bool> finalVec;
-    // encode input data to bit vector
-    for (uint8_t symbol : vec)
-    {
-        vector<bool> symbolCode = huffTree.encode(symbol);
-        // append symbol code to the existing code
-        finalVec.insert(finalVec.end(), symbolCode.begin(), symbolCode.end());
-        huffTree.update(symbol);
+    CanonHuffCode huffCode;
+    huffCode.build(symbolFreqs);
+
+    // first header with code lengths
+    for (uint8_t headerByte : createStaticHuffHeader(huffCode.getCodeLengths())) {
+        writer.write(headerByte, CHAR_BIT);
     }
 
-    // add remaining bits so their final count is divisible by bits in symbol
-    while (finalVec.size() % CHAR_BIT != 0) {
-        finalVec.push_back(0); // value does not matter
+    // second pass to encode input data
+    uint64_t firstBit = writer.getBitCount();
+    for (uint8_t symbol : vec) {
+        huffCode.encode(symbol, writer);
+    }
+
+    if (stats != nullptr) {
+        stats->addHuffStats(getStaticHuffStats(
+            huffCode, vec.size(), writer.getBitCount() - firstBit));
     }
 
-    return finalVec;
+    // add remaining bits so their final count is divisible by bits in symbol
+    writer.flush();
 }
 
-deque<uint8_t> revertHuffman(deque<bool> &deq, uint64_t byteCount)
+void revertStaticHuffman(
+    BitReader &reader,
+    uint64_t byteCount,
+    vector<uint8_t> &outVec,
+    CodecStats *stats)
 {
-    HuffTree huffTree; // create the Huffman FGK tree
+    CanonHuffCode huffCode;
+    if (!huffCode.setCodeLengths(extractStaticHuffHeader(reader).data())) {
+        throw CodecError("invalid static Huffman header", 17);
+    }
+    uint64_t remainBitCount = reader.getRemainBitCount();
 
-    deque<uint8_t> finalDeq;
+    outVec.resize(byteCount); // all bytes are overwritten
     for (uint64_t i = 0; i < byteCount; i++)
     {
-        int decResult = huffTree.decode(&deq);
-        if (decResult == -1)
-        {
-            cerr << "ERROR: invalid Huffman coding file contents\n";
-            exit(9);
+        int decResult = huffCode.decode(reader);
+        if (decResult == -1) {
+            throw CodecError("invalid Huffman coding file contents", 9);
         }
-        uint8_t symbol = decResult;
-    
-        huffTree.update(symbol);
-        finalDeq.push_back(symbol);
+        outVec[i] = decResult;
     }
 
-    return finalDeq;
+    if (stats != nullptr) {
+        stats->addHuffStats(getStaticHuffStats(
+            huffCode, byteCount, remainBitCount - reader.getRemainBitCount()));
+    }
 }
 
 // -------------------------- HELPER FUNCTIONS ---------------------------------
@@ -416,3 +952,7 @@ uint64_t getBlockCount(
     uint64_t height = matrixHeight / blockSize + (matrixHeight % blockSize != 0);
     return width * height;
 }
+
+uint64_t getBlockRowCount(uint64_t matrixHeight, uint64_t blockSize) {
+    return matrixHeight / blockSize + (matrixHeight % blockSize != 0);
+}
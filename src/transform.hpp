@@ -9,41 +9,124 @@
 
 #include <vector>
 #include <cstdint>
-#include <deque>
+#include <tuple>
+
+#include "bitstream.hpp"
+#include "threadpool.hpp"
+#include "stats.hpp"
 
-using std::deque;
 using std::vector;
+using std::tuple;
 
 #define INIT_RLE_BLOCK_SIZE 8
 #define MAX_RLE_DOUBLING_STEPS 7 // for searching optimal block size
+#define CONTEXT_SHIFT 3 // previous symbols are bucketed to 32 contexts (less dilution)
 
 
 // transform pixel values to their differences (in situ)
 // this algorithm utilizes the properties of two's complement (underflow)
+// vectorized kernel is used when supported by the CPU
 void applyDiffModel(vector<uint8_t> &vec);
-// revert the differential model (in situ)
+// revert the differential model (in situ), it is a prefix sum of differences
 // also uses the two's complement properties (overflow)
-void revertDiffModel(vector<uint8_t> &vec);
+void revertDiffModel(uint8_t *data, uint64_t size);
 
-// apply run-length encoding without explicit tag (MNP-5 Microcom format)
-vector<uint8_t> applyRLE(const vector<uint8_t> &vec);
-// recover the given RLE-encoded data
-vector<uint8_t> revertRLE(const deque<uint8_t> &deq);
+// apply run-length encoding without explicit tag (MNP-5 Microcom format), encoded
+// data replace the contents of given vector (its capacity is reused)
+void applyRLE(const vector<uint8_t> &vec, vector<uint8_t> &outVec);
+// recover the given RLE-encoded data to given output of expected size
+void revertRLE(const uint8_t *data, uint64_t size, uint8_t *outData, uint64_t outSize);
+// return the size of recovered RLE-encoded data (without recovering them)
+uint64_t getRLERawSize(const uint8_t *data, uint64_t size);
 
 // apply adaptive block RLE with the best found block size (automatically)
 // it also creates its header (besides others, block size is stored there)
-vector<uint8_t> applyAdaptRLE(
+// all block sizes and scan directions of blocks are tried in parallel
+// lengths of rows of blocks may be stored in the header, so they can be decoded in
+// parallel (they are counted in the search of block size)
+// the chosen block size and scan directions are added to statistics (if any)
+// encoded data replace the contents of given vector (its capacity is reused)
+void applyAdaptRLE(
     const vector<uint8_t> &matrix,
     uint64_t matrixWidth,
-    uint64_t matrixHeight);
-// revert adaptive block RLE, it also parses its header and set up
-// configuration based on it (e.g., block size)
-vector<uint8_t> revertAdaptRLE(deque<uint8_t> &deq);
+    uint64_t matrixHeight,
+    bool rowLengthsStored,
+    vector<uint8_t> &outVec,
+    ThreadPool &threadPool,
+    CodecStats *stats = nullptr);
+// apply adaptive block RLE like above to tiled data, where each row of blocks is
+// coded independently later, so its header is created separately (with offsets)
+// it returns a tuple of:
+//   * data of all blocks (without the header)
+//   * block size
+//   * bit vector of block scan directions
+//   * index of data of each row of blocks (the last item is their total size)
+tuple<vector<uint8_t>, uint64_t, vector<bool>, vector<uint64_t>> applyTiledAdaptRLE(
+    const uint8_t *matrix,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    ThreadPool &threadPool,
+    CodecStats *stats = nullptr);
+// revert adaptive block RLE to given output of expected size, it also parses its
+// header and set up configuration based on it (e.g., block size)
+// rows of blocks are decoded in parallel if their lengths are stored in the header
+void revertAdaptRLE(
+    const uint8_t *data,
+    uint64_t size,
+    uint8_t *outData,
+    uint64_t outSize,
+    bool rowLengthsStored,
+    ThreadPool &threadPool,
+    CodecStats *stats = nullptr);
+// revert given row of blocks of tiled adaptive block RLE (its data only, the header
+// is parsed separately) to given output, which holds whole lines of the row
+void revertAdaptRLERow(
+    const uint8_t *data,
+    uint64_t size,
+    uint64_t matrixWidth,
+    uint64_t matrixHeight,
+    uint64_t blockSize,
+    const vector<bool> &scanDirs,
+    uint64_t row,
+    uint8_t *outData);
+// return the size of recovered 2D data (based on adaptive block RLE header)
+uint64_t getAdaptRLERawSize(const uint8_t *data, uint64_t size);
+
+// apply adaptive Huffman coding (FGK or Vitter) and write the code to given writer
+// with contexts, there is a separate tree for each bucket of previous symbols
+// internals of the tree are added to statistics (if any)
+void applyHuffman(
+    const vector<uint8_t> &vec,
+    bool useVitter,
+    bool useContexts,
+    BitWriter &writer,
+    CodecStats *stats = nullptr);
+// revert adaptive Huffman coding of given bits and expected count of bytes
+// rescaling of tree frequencies must be the same as when encoding (older streams
+// were encoded without it), decode table may be disabled to decode bit by bit
+// (the result is the same), decoded bytes replace the contents of given vector
+// (its capacity is reused)
+void revertHuffman(
+    BitReader &reader,
+    uint64_t byteCount,
+    bool useVitter,
+    bool useContexts,
+    bool useRescaling,
+    bool useDecodeTable,
+    vector<uint8_t> &outVec,
+    CodecStats *stats = nullptr);
 
-// apply Huffman FGK coding and return bit vector
-vector<bool> applyHuffman(const vector<uint8_t> &vec);
-// revert Huffman coding of given bits and expected count of bytes
-deque<uint8_t> revertHuffman(deque<bool> &deq, uint64_t byteCount);
+// apply static canonical Huffman coding (two passes), its header is written first
+void applyStaticHuffman(const vector<uint8_t> &vec, BitWriter &writer, CodecStats *stats = nullptr);
+// revert static canonical Huffman coding (its header is read first), decoded bytes
+// replace the contents of given vector (its capacity is reused)
+void revertStaticHuffman(
+    BitReader &reader,
+    uint64_t byteCount,
+    vector<uint8_t> &outVec,
+    CodecStats *stats = nullptr);
 
 // returns the total number of blocks in the matrix
 uint64_t getBlockCount(uint64_t matrixWidth, uint64_t matrixHeight, uint64_t blockSize);
+// returns the number of rows of blocks in the matrix
+uint64_t getBlockRowCount(uint64_t matrixHeight, uint64_t blockSize);
@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// The implementation of adaptive Huffman tree updated by Vitter algorithm.
+//------------------------------------------------------------------------------
+
+#include "vitter.hpp"
+
+// -------------------------- PUBLIC -------------------------------------------
+
+void VitterTree::update(uint8_t symbol)
+{
+    uint16_t node = symbolNodes[symbol];
+    uint16_t leafToIncrement = NULL_NODE; // leaf to be processed after the others
+
+    if (node == NULL_NODE) // NYT node splitting (add new symbol)
+    {
+        leafToIncrement = splitNYT(symbol);
+        node = nodes[leafToIncrement].parent; // former NYT node (now internal)
+    }
+    else
+    {
+        uint16_t leader = findLeader(node);
+        if (leader != node) {
+            swapNodes(node, leader);
+        }
+
+        // sibling is NYT node, so the parent has the same frequency as the node
+        if (nodes[node].parent == nodes[nodeNYT].parent)
+        {
+            leafToIncrement = node;
+            node = nodes[node].parent;
+        }
+    }
+
+    while (node != root) {
+        node = slideAndIncrement(node);
+    }
+    nodes[root].freq++; // root is always alone in its block
+
+    if (leafToIncrement != NULL_NODE) {
+        slideAndIncrement(leafToIncrement);
+    }
+
+    if (needsRescaling()) {
+        rescale(true);
+    }
+}
+
+// -------------------------- PRIVATE ------------------------------------------
+
+uint16_t VitterTree::findLeader(uint16_t node)
+{
+    uint16_t leader = node;
+
+    // the block is formed by contiguous node numbers
+    while (nodes[leader].nodeNum + 1 < MAX_NODES)
+    {
+        uint16_t nextNode = numberedNodes[nodes[leader].nodeNum + 1];
+        if (nodes[nextNode].freq != nodes[node].freq ||
+            isLeaf(nodes[nextNode]) != isLeaf(nodes[node])) {
+            break;
+        }
+        leader = nextNode;
+    }
+
+    return leader;
+}
+
+uint16_t VitterTree::slideAndIncrement(uint16_t node)
+{
+    uint16_t formerParent = nodes[node].parent;
+    bool nodeIsLeaf = isLeaf(nodes[node]);
+
+    // leaf slides ahead of internal nodes with the same frequency, internal node
+    // slides ahead of leaves with its frequency increased by one
+    uint32_t slideFreq = nodeIsLeaf ? nodes[node].freq : nodes[node].freq + 1;
+    while (nodes[node].nodeNum + 1 < MAX_NODES)
+    {
+        uint16_t nextNode = numberedNodes[nodes[node].nodeNum + 1];
+        if (nodes[nextNode].freq != slideFreq || isLeaf(nodes[nextNode]) == nodeIsLeaf) {
+            break;
+        }
+        swapNodes(node, nextNode); // nodes ahead are shifted by one position back
+    }
+    nodes[node].freq++;
+
+    // internal node continues with its former parent (it is the leader of its block)
+    return nodeIsLeaf ? nodes[node].parent : formerParent;
+}
@@ -0,0 +1,30 @@
+//------------------------------------------------------------------------------
+// Copyright 2022 Dominik Salvet
+// https://github.com/dominiksalvet/huffman-codec
+//------------------------------------------------------------------------------
+// Header file for adaptive Huffman tree updated by Vitter algorithm.
+//------------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstdint>
+
+#include "huffman.hpp"
+
+
+// adaptive Huffman tree updated by Vitter algorithm (also known as algorithm Lambda)
+// nodes are numbered by frequency, and leaves precede internal nodes of the same
+// frequency, what minimizes both the sum and the maximum of code lengths
+class VitterTree : public AdaptHuffTree
+{
+public:
+    // update the tree based on given symbol
+    void update(uint8_t symbol);
+
+private:
+    // return the node with the greatest node number of the same type and frequency
+    uint16_t findLeader(uint16_t node);
+    // slide given node ahead of the following block and increase its frequency
+    // it returns the next node to be processed
+    uint16_t slideAndIncrement(uint16_t node);
+};